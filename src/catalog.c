@@ -0,0 +1,272 @@
+/**
+ * Copyright (c) 2023 Adrian Siekierka
+ *
+ * CartFriend is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * CartFriend is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with CartFriend. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <ws.h>
+#include "catalog.h"
+#include "config.h"
+#include "driver.h"
+#include "settings.h"
+#include "ui.h"
+
+#ifdef USE_SLOT_SYSTEM
+
+const uint8_t __far rom_size_table[ROM_SIZE_TABLE_LEN] = {
+    1, 2, 4, 8, 16, 24, 32, 48, 64, 128
+};
+
+static bool catalog_read_rom_header_bank(void *buffer, uint8_t slot, uint8_t bank) {
+    return driver_read_slot(buffer, slot, bank, 0xFFF0, 16);
+}
+
+bool catalog_read_rom_header(void *buffer, uint8_t id) {
+    return catalog_read_rom_header_bank(buffer, catalog_entry_slot(id), catalog_entry_bank(id));
+}
+
+bool catalog_is_valid_rom_header(const uint8_t *buffer) {
+    // is the first byte a valid jump call?
+    if (buffer[0] == 0xEA || buffer[0] == 0x9A) {
+        // are maintenance bits not set?
+        if (!(buffer[5] & 0x0F)) {
+            // is the target plausibly outside of internal RAM?
+            uint16_t dest_high = *((uint16_t*) (buffer + 3));
+            if (dest_high != 0xFFFF && dest_high != 0x0000) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static void catalog_entry_from_header(catalog_entry_t *entry, uint8_t id, const uint8_t *buffer) {
+    entry->id = id;
+    entry->publisher_id = buffer[0x06];
+    entry->game_id = buffer[0x08];
+    entry->game_version = buffer[0x09];
+    entry->rom_size = buffer[0x0A];
+    entry->save_type = buffer[0x0B];
+    entry->checksum = *((uint16_t*) (buffer + 0x0E));
+    entry->flags = 0;
+}
+
+bool catalog_entry_matches_header(const catalog_entry_t *entry, const uint8_t *buffer) {
+    catalog_entry_t header_entry;
+    catalog_entry_from_header(&header_entry, entry->id, buffer);
+    header_entry.flags = entry->flags;
+    return !memcmp(entry, &header_entry, sizeof(catalog_entry_t));
+}
+
+void catalog_mark_slot_changed(void) {
+    settings_local.slot_generation++;
+    settings_mark_changed();
+}
+
+// Catalog entry currently being verified, or 0xFF.
+static uint8_t verify_entry = 0xFF;
+static uint16_t verify_block;
+static uint16_t verify_sum;
+// verification results which have not been stored yet
+static bool verify_unsaved;
+
+void catalog_invalidate(void) {
+    settings_local.catalog.count = CATALOG_COUNT_INVALID;
+    verify_entry = 0xFF;
+}
+
+static void catalog_save(void) {
+    // The catalog is only a cache, so persist it right away - unless the
+    // user has unsaved changes, which should not be committed behind their
+    // back. In that case, it will be stored along with the next save.
+    if (!settings_changed) {
+        settings_changed = true;
+        settings_save();
+    }
+}
+
+// Multilinear slots can hold one ROM per 1MB (16 banks) of space.
+#define MULTILINEAR_SUB_SLOTS 8
+
+static void catalog_scan_slot(catalog_t *catalog, uint8_t slot) {
+    uint8_t headers[MULTILINEAR_SUB_SLOTS][16];
+    uint8_t header_count = 1;
+    uint8_t buffer[16];
+
+    // Read all candidate headers at once; every separate read would mean
+    // switching to the slot and back again.
+    if (settings_local.slot_type[slot] == SLOT_TYPE_MULTILINEAR_SOFT) {
+        header_count = MULTILINEAR_SUB_SLOTS;
+    }
+    _nmemset(headers, 0xFF, sizeof(headers));
+    if (!driver_read_rom_headers(headers, slot, 0xFF, header_count, 0x10)) {
+        return;
+    }
+
+    int16_t bank = 0xFF;
+    while (bank >= 0x80) {
+        ui_step_work_indicator();
+        uint8_t *header = headers[(0xFF - bank) >> 4];
+        if ((bank & 0x0F) != 0x0F) {
+            // not aligned to a sub-slot, fall back to a separate read
+            _nmemset(buffer, 0xFF, sizeof(buffer));
+            if (!catalog_read_rom_header_bank(buffer, slot, bank)) {
+                break;
+            }
+            header = buffer;
+        }
+
+        if (catalog_is_valid_rom_header(header)) {
+            if (catalog->count >= CATALOG_MAX_ENTRIES) {
+                catalog->flags |= CATALOG_TRUNCATED;
+                break;
+            }
+            uint8_t id = slot | ((bank & 0xF0) ^ 0xF0);
+            catalog_entry_from_header(catalog->entries + (catalog->count++), id, header);
+
+            if (settings_local.slot_type[slot] == SLOT_TYPE_MULTILINEAR_SOFT) {
+                if (header[10] < sizeof(rom_size_table)) {
+                    uint16_t size_banks = ((uint16_t) rom_size_table[header[10]]) * 2;
+                    if (size_banks < 16) size_banks = 16;
+                    bank -= size_banks;
+                    continue;
+                }
+            }
+        }
+        break;
+    }
+}
+
+bool catalog_is_current(void) {
+    const catalog_t *catalog = &settings_local.catalog;
+    return catalog->count != CATALOG_COUNT_INVALID && catalog->generation == settings_local.slot_generation;
+}
+
+bool catalog_refresh(void) {
+    catalog_t *catalog = &settings_local.catalog;
+
+    if (catalog_is_current()) {
+        return false;
+    }
+
+    catalog->count = 0;
+    catalog->flags = 0;
+
+    ui_step_work_indicator();
+    driver_unlock();
+    for (uint8_t slot = 0; slot < GAME_SLOTS; slot++) {
+        if (settings_local.slot_type[slot] == SLOT_TYPE_UNUSED) {
+            continue;
+        }
+        catalog_scan_slot(catalog, slot);
+    }
+    driver_lock();
+
+    catalog->generation = settings_local.slot_generation;
+    verify_entry = 0xFF;
+    verify_unsaved = false;
+    catalog_save();
+
+    ui_clear_work_indicator();
+    return true;
+}
+
+void catalog_flush(void) {
+    // Writing the settings takes a while, so results are stored in batches:
+    // once a pass over the catalog is done, or the user moves on.
+    if (verify_unsaved) {
+        verify_unsaved = false;
+        catalog_save();
+    }
+}
+
+bool catalog_verify_step(uint8_t only_entry, uint16_t max_blocks, bool interruptible) {
+    catalog_t *catalog = &settings_local.catalog;
+    if (catalog->count == CATALOG_COUNT_INVALID) {
+        return false;
+    }
+
+    if (verify_entry == 0xFF || (only_entry != 0xFF && verify_entry != only_entry)) {
+        // find the next entry to verify
+        verify_entry = 0xFF;
+        for (uint8_t i = 0; i < catalog->count; i++) {
+            if (only_entry != 0xFF && i != only_entry) continue;
+            if (!(catalog->entries[i].flags & CATALOG_ENTRY_CHECKED)) {
+                verify_entry = i;
+                verify_block = 0;
+                verify_sum = 0;
+                break;
+            }
+        }
+        if (verify_entry == 0xFF) {
+            if (only_entry == 0xFF) {
+                // the pass is done
+                catalog_flush();
+            }
+            return false;
+        }
+    }
+
+    catalog_entry_t *entry = catalog->entries + verify_entry;
+    uint16_t banks = entry->rom_size < sizeof(rom_size_table) ? rom_size_table[entry->rom_size] * 2 : 0xFFFF;
+    uint8_t bank_top = catalog_entry_bank(entry->id);
+    if (banks > (bank_top - 0x7F)) {
+        entry->flags |= CATALOG_ENTRY_CHECKED | CATALOG_ENTRY_UNVERIFIABLE;
+        verify_entry = 0xFF;
+        verify_unsaved = true;
+        return true;
+    }
+
+    uint16_t blocks = (banks << 8) - verify_block;
+    if (blocks > max_blocks) {
+        blocks = max_blocks;
+    }
+
+    driver_unlock();
+    verify_block += driver_sum_slot(&verify_sum, catalog_entry_slot(entry->id),
+        bank_top + 1 - banks + (verify_block >> 8), (verify_block & 0xFF) << 8, blocks, interruptible);
+    driver_lock();
+
+    if (verify_block < (banks << 8)) {
+        return false;
+    }
+
+    // the checksum does not include its own two bytes at the end of the ROM
+    verify_sum -= (entry->checksum & 0xFF) + (entry->checksum >> 8);
+    entry->flags |= CATALOG_ENTRY_CHECKED;
+    if (verify_sum != entry->checksum) {
+        entry->flags |= CATALOG_ENTRY_CORRUPT;
+    }
+    verify_entry = 0xFF;
+    verify_unsaved = true;
+    return true;
+}
+
+bool catalog_verify_entry(uint8_t entry_id) {
+    const catalog_entry_t *entry = settings_local.catalog.entries + entry_id;
+    if (settings_local.catalog.count == CATALOG_COUNT_INVALID) {
+        return true;
+    }
+    while (!(entry->flags & CATALOG_ENTRY_CHECKED)) {
+        ui_step_work_indicator();
+        catalog_verify_step(entry_id, 0x1000, false);
+    }
+    ui_clear_work_indicator();
+    return !(entry->flags & CATALOG_ENTRY_CORRUPT);
+}
+
+#endif
@@ -0,0 +1,114 @@
+#pragma once
+/**
+ * Copyright (c) 2023 Adrian Siekierka
+ *
+ * CartFriend is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * CartFriend is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with CartFriend. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// CartFriend - slot catalog
+//
+// The catalog caches the ROM headers found in all game slots, so that the
+// Browse tab does not have to mount every slot each time it is opened. It is
+// stored as part of the settings block (see settings.h) and is considered
+// stale whenever settings_local.slot_generation no longer matches the
+// generation it was built from.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wonderful.h>
+
+// as many as fit the settings record (see settings.h); slots can hold more
+#define CATALOG_MAX_ENTRIES 64
+#define CATALOG_COUNT_INVALID 0xFF
+
+#define ROM_SIZE_TABLE_LEN 10
+
+typedef struct __attribute__((packed)) {
+	uint8_t id; // slot | (sub-slot << 4)
+	uint8_t publisher_id; // header byte 6
+	uint8_t game_id; // header byte 8
+	uint8_t game_version; // header byte 9
+	uint8_t rom_size; // header byte 10
+	uint8_t save_type; // header byte 11
+	uint16_t checksum; // header bytes 14-15
+	uint8_t flags;
+} catalog_entry_t;
+
+// the full ROM has been summed up and compared against the header checksum
+#define CATALOG_ENTRY_CHECKED 0x01
+// ... and they did not match
+#define CATALOG_ENTRY_CORRUPT 0x02
+// the size is unknown or does not fit the slot, so there is nothing to compare
+#define CATALOG_ENTRY_UNVERIFIABLE 0x04
+
+// more ROMs were found than the catalog can hold
+#define CATALOG_TRUNCATED 0x01
+
+typedef struct __attribute__((packed)) {
+	uint8_t generation;
+	uint8_t count;
+	uint8_t flags;
+	catalog_entry_t entries[CATALOG_MAX_ENTRIES];
+} catalog_t;
+
+// in mbits
+extern const uint8_t __far rom_size_table[ROM_SIZE_TABLE_LEN];
+
+static inline uint8_t catalog_entry_slot(uint8_t id) {
+	return id & 0x0F;
+}
+
+static inline uint8_t catalog_entry_bank(uint8_t id) {
+	return 0xFF - (id & 0xF0);
+}
+
+bool catalog_read_rom_header(void *buffer, uint8_t id);
+bool catalog_is_valid_rom_header(const uint8_t *buffer);
+bool catalog_entry_matches_header(const catalog_entry_t *entry, const uint8_t *buffer);
+
+/**
+ * @brief Mark the contents or the layout of a game slot as changed.
+ * The catalog will be rebuilt on the next call to catalog_refresh().
+ */
+void catalog_mark_slot_changed(void);
+void catalog_invalidate(void);
+
+bool catalog_is_current(void);
+
+/**
+ * @brief Rebuild the catalog, if it is stale.
+ * @return true if the catalog was rebuilt.
+ */
+bool catalog_refresh(void);
+
+/**
+ * @brief Continue verifying the checksum of the next unchecked catalog entry.
+ * Its slot is mounted once for the whole step.
+ * @param only_entry If not 0xFF, only this catalog entry is considered.
+ * @param max_blocks The maximum number of 256-byte blocks to read in this step.
+ * @param interruptible Stop the step early once a key is pressed.
+ * @return true if an entry has finished verification.
+ */
+bool catalog_verify_step(uint8_t only_entry, uint16_t max_blocks, bool interruptible);
+
+/**
+ * @brief Store the verification results gathered since the last call.
+ */
+void catalog_flush(void);
+
+/**
+ * @brief Verify the checksum of a catalog entry, if this has not been done yet.
+ * @return true if the entry is not known to be corrupt.
+ */
+bool catalog_verify_entry(uint8_t entry_id);
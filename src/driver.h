@@ -27,10 +27,25 @@
 #include <stdint.h>
 #include <wonderful.h>
 
+// Hardware interrupts left enabled while driver_read_slot(),
+// driver_write_slot() and driver_erase_bank() run. Their handlers must live in RAM, as the cartridge
+// ROM may be unavailable at that time. 0 by default.
+extern uint8_t driver_hwint_mask;
+
 void driver_init(void);
 void driver_lock(void);
 void driver_unlock(void);
 bool driver_read_slot(void *ptr, uint16_t slot, uint16_t bank, uint16_t offset, uint16_t len) __far;
+// reads the 16-byte ROM headers of count banks, starting at bank and moving down by step, in one go
+bool driver_read_rom_headers(void *ptr, uint16_t slot, uint16_t bank, uint16_t count, uint16_t step) __far;
+// adds up the bytes of count 256-byte blocks, starting at bank:offset and continuing into the following banks, to *sum;
+// if interruptible, stops early once a key is pressed; returns the number of blocks added up
+uint16_t driver_sum_slot(uint16_t *sum, uint16_t slot, uint16_t bank, uint16_t offset, uint16_t count, bool interruptible) __far;
+// like driver_read_slot, but to ptr in the currently selected SRAM bank
+bool driver_read_slot_sram(uint16_t ptr, uint16_t slot, uint16_t bank, uint16_t offset, uint16_t len) __far;
+// stores a hash for each of count 4096-byte blocks, starting at bank:offset, in hashes:
+// the low word is the 16-bit sum of all bytes, the high word the 16-bit sum of all running sums
+bool driver_hash_slot(uint32_t *hashes, uint16_t slot, uint16_t bank, uint16_t offset, uint16_t count) __far;
 bool driver_write_slot(const void *data, uint16_t slot, uint16_t bank, uint16_t offset, uint16_t len) __far;
 bool driver_erase_bank(uint16_t unused, uint16_t slot, uint16_t bank) __far;
 void driver_launch_slot(uint16_t unused, uint16_t slot, uint16_t bank) __far; // unlock first, lock in function 
@@ -28,11 +28,16 @@
 	.code16
 	.intel_syntax noprefix
 	.global driver_read_slot
+	.global driver_read_slot_sram
+	.global driver_hash_slot
+	.global driver_read_rom_headers
+	.global driver_sum_slot
 	.global driver_write_slot
 	.global driver_erase_bank
 	.global driver_launch_slot
 	.global fm_initial_slot
 	.global _fm_unlock_refcount
+	.global driver_hwint_mask
 
 	.section .text
 	.align 2
@@ -231,9 +236,15 @@ _driver_unswitch_slot:
 	ret
 
 // preserves AX
+// only the interrupts in driver_hwint_mask are left enabled
 _driver_switch_slot_sram:
 	cli
 	push ax
+	in al, 0xB2
+	mov [_driver_hwint_temp], al
+	and al, [driver_hwint_mask]
+	out 0xB2, al
+	sti
 	in al, 0xC1
 	mov [_driver_bank_temp], al
 	mov al, 1
@@ -248,7 +259,13 @@ _driver_unswitch_slot_sram:
 	out 0xCE, al
 	mov al, [_driver_bank_temp]
 	out 0xC1, al
-	jmp _driver_unswitch_slot
+	mov dl, [fm_initial_slot]
+	call _driver_switch_slot
+	cli
+	mov al, [_driver_hwint_temp]
+	out 0xB2, al
+	sti
+	ret
 
 _driver_reset_flash:
 	push ds
@@ -270,6 +287,10 @@ driver_read_slot:
 	mov	bp, sp
 
 	mov di, ax
+	// reading through ROM1 keeps interrupts disabled; if some are to be kept
+	// running, map the slot into the SRAM window instead, as writes do
+	cmp byte ptr [driver_hwint_mask], 0
+	jne _drs_irq
 	call _driver_switch_slot_bank1
 
 	mov bx, 0x3000
@@ -279,6 +300,40 @@ driver_read_slot:
 
 	mov si, [bp + 14]
 _drs_part2:
+	call _drs_copy
+	pop	bp
+	pop	es
+	pop	ds
+
+	call _driver_unswitch_slot_bank1
+_drs_finish:
+	mov al, 1
+
+	pop	di
+	pop	si
+
+	call driver_slot_finish_error_check
+	retf 0x4
+
+_drs_irq:
+	call _driver_switch_slot_sram
+
+	mov bx, 0x1000
+	mov	ds, bx
+	xor bx, bx
+	mov es, bx
+
+	mov si, [bp + 14]
+	call _drs_copy
+	pop	bp
+	pop	es
+	pop	ds
+
+	call _driver_unswitch_slot_sram
+	jmp _drs_finish
+
+// ds:si = source, es:di = destination, [bp + 16] = length
+_drs_copy:
 	mov	cx, [bp + 16]
 	shr	cx, 1
 	cld
@@ -286,17 +341,209 @@ _drs_part2:
 	jnc	_drs_no_byte
 	movsb
 _drs_no_byte:
+	ret
+
+	.align 2
+driver_read_slot_sram:
+	push	si
+	push	di
+	push	ds
+	push	es
+	push	bp
+	mov	bp, sp
+
+	mov di, ax
+	call _driver_switch_slot_bank1
+
+	mov bx, 0x3000
+	mov	ds, bx
+	mov bx, 0x1000
+	mov es, bx
+
+	mov si, [bp + 14]
+	jmp _drs_part2
+
+	.align 2
+driver_read_rom_headers:
+	push	si
+	push	di
+	push	ds
+	push	es
+	push	bp
+	mov	bp, sp
+
+	mov di, ax
+	call _driver_switch_slot_bank1
+
+	mov bx, 0x3000
+	mov	ds, bx
+	xor bx, bx
+	mov es, bx
+
+	mov	bx, [bp + 14] // count
+	mov	dx, [bp + 16] // step
+	mov	al, cl
+	cld
+	.balign 2, 0x90
+_drrh_loop:
+	mov	si, 0xFFF0
+	mov	cx, 8
+	rep	movsw
+	dec	bx
+	jz	_drrh_done
+	sub	al, dl
+	out	0xC3, al
+	jmp	_drrh_loop
+
+_drrh_done:
 	pop	bp
 	pop	es
 	pop	ds
 
 	call _driver_unswitch_slot_bank1
+
+	pop	di
+	pop	si
+
+	call driver_slot_finish_error_check
 	mov al, 1
+	retf 0x4
+
+	.align 2
+driver_sum_slot:
+	push	si
+	push	di
+	push	ds
+	push	es
+	push	bp
+	mov	bp, sp
+
+	push	ax // sum pointer
+	mov	bx, ax
+	mov	di, [bx]
+	call _driver_switch_slot_bank1
+
+	mov	bl, cl
+	mov	si, [bp + 14] // offset, 256-byte aligned
+	mov	dx, [bp + 16] // block count
+	mov	ax, 0x3000
+	mov	ds, ax
+	xor	ax, ax
+	cld
+	.balign 2, 0x90
+_dss_block:
+	mov	cx, 16
+	.balign 2, 0x90
+_dss_loop:
+	.rept 16
+	lodsb
+	add	di, ax
+	.endr
+	loop	_dss_loop
+
+	// crossed into the next bank?
+	test	si, si
+	jnz	_dss_next_block
+	inc	bl
+	mov	al, bl
+	out	0xC3, al
+_dss_next_block:
+	dec	dx
+	jz	_dss_done
+	// if interruptible, stop as soon as any key is pressed
+	cmp	byte ptr [bp + 18], 0
+	je	_dss_block
+	mov	al, 0x70
+	out	0xB5, al
+	daa
+	in	al, 0xB5
+	and	al, 0x0F
+	jz	_dss_block
+
+_dss_done:
+	pop	bx // sum pointer
+	mov	ax, [bp + 16]
+	sub	ax, dx
+	pop	bp
+	pop	es
+	pop	ds
+	mov	[bx], di
+	mov	bx, ax
+
+	call _driver_unswitch_slot_bank1
 
 	pop	di
 	pop	si
 
 	call driver_slot_finish_error_check
+	mov	ax, bx
+	retf 0x6
+
+	.align 2
+driver_hash_slot:
+	push	si
+	push	di
+	push	ds
+	push	es
+	push	bp
+	mov	bp, sp
+
+	mov di, ax
+	call _driver_switch_slot_bank1
+
+	mov	bl, cl
+	mov	si, [bp + 14] // offset, 4096-byte aligned
+	mov	dx, [bp + 16] // block count
+	mov	ax, 0x3000
+	mov	ds, ax
+	xor	ax, ax
+	mov	es, ax
+	cld
+	.balign 2, 0x90
+_dhs_block:
+	// di = sum1, bp = sum2
+	push	di
+	xor	di, di
+	xor	bp, bp
+	mov	cx, 512
+	.balign 2, 0x90
+_dhs_loop:
+	.rept 8
+	lodsb
+	add	di, ax
+	add	bp, di
+	.endr
+	loop	_dhs_loop
+
+	mov	ax, di
+	pop	di
+	stosw
+	mov	ax, bp
+	stosw
+	xor	ax, ax
+
+	// crossed into the next bank?
+	test	si, si
+	jnz	_dhs_next_block
+	inc	bl
+	mov	al, bl
+	out	0xC3, al
+	xor	ax, ax
+_dhs_next_block:
+	dec	dx
+	jnz	_dhs_block
+
+	pop	bp
+	pop	es
+	pop	ds
+
+	call _driver_unswitch_slot_bank1
+
+	pop	di
+	pop	si
+
+	call driver_slot_finish_error_check
+	mov al, 1
 	retf 0x4
 
 	.align 2
@@ -533,6 +780,10 @@ _end_loop:
 	.section .bss
 _driver_bank_temp:
 	.byte 0
+_driver_hwint_temp:
+	.byte 0
+driver_hwint_mask:
+	.byte 0
 _driver_current_slot:
 	.byte 0
 _fm_unlock_refcount:
@@ -0,0 +1,154 @@
+/**
+ * Copyright (c) 2023 Adrian Siekierka
+ *
+ * CartFriend is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * CartFriend is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with CartFriend. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <wonderful.h>
+#include "format.h"
+
+static const char __far hex_digits[] = "0123456789ABCDEF";
+
+// Writes the digits of value right-to-left, ending at d.
+static char *format_number(char *d, uint32_t value, bool hex) {
+    // reduce to 16 bits first, so that most values avoid 32-bit division
+    while (value > 0xFFFF) {
+        if (hex) {
+            *(--d) = hex_digits[value & 0xF];
+            value >>= 4;
+        } else {
+            *(--d) = '0' + (value % 10);
+            value /= 10;
+        }
+    }
+
+    uint16_t v = value;
+    do {
+        if (hex) {
+            *(--d) = hex_digits[v & 0xF];
+            v >>= 4;
+        } else {
+            *(--d) = '0' + (v % 10);
+            v /= 10;
+        }
+    } while (v != 0);
+    return d;
+}
+
+uint16_t format_vsnprintf(char *buf, uint16_t buf_len, const char __far* format, va_list val) {
+    char digits[12];
+    char *p = buf;
+    char *end = buf + buf_len - 1;
+
+    if (buf_len == 0) {
+        return 0;
+    }
+
+    while (*format != '\0' && p < end) {
+        char c = *(format++);
+        if (c != '%') {
+            *(p++) = c;
+            continue;
+        }
+
+        char pad = ' ';
+        uint8_t width = 0;
+        bool is_long = false;
+        if (*format == '0') {
+            pad = '0';
+            format++;
+        }
+        while (*format >= '0' && *format <= '9') {
+            width = width * 10 + (*(format++) - '0');
+        }
+        if (*format == 'l') {
+            is_long = true;
+            format++;
+        }
+
+        const char __far* str = digits;
+        uint8_t len;
+        char sign = 0;
+        c = *format;
+        if (c == '\0') {
+            break;
+        }
+        format++;
+
+        switch (c) {
+        case 'c':
+            digits[0] = va_arg(val, int);
+            len = 1;
+            break;
+        case 's':
+            str = va_arg(val, const char __far*);
+            for (len = 0; str[len] != '\0' && len < 0xFF; len++);
+            break;
+        case 'd':
+        case 'u':
+        case 'X': {
+            uint32_t value = is_long ? va_arg(val, uint32_t) : va_arg(val, unsigned int);
+            if (c == 'd') {
+                if (is_long ? ((int32_t) value < 0) : ((int16_t) value < 0)) {
+                    sign = '-';
+                    value = is_long ? -value : (uint16_t) -((int16_t) value);
+                }
+            }
+            char *d_end = digits + sizeof(digits);
+            str = format_number(d_end, value, c == 'X');
+            len = d_end - str;
+        } break;
+        default:
+            // '%%', or an unsupported directive - print as-is
+            digits[0] = c;
+            len = 1;
+            break;
+        }
+
+        if (sign != 0) {
+            if (pad == '0') {
+                *(p++) = sign;
+                sign = 0;
+            }
+            if (width > 0) {
+                width--;
+            }
+        }
+        for (; width > len && p < end; width--) {
+            *(p++) = pad;
+        }
+        if (sign != 0 && p < end) {
+            *(p++) = sign;
+        }
+        while (len > 0 && p < end) {
+            *(p++) = *(str++);
+            len--;
+        }
+    }
+
+    *p = '\0';
+    return p - buf;
+}
+
+uint16_t format_snprintf(char *buf, uint16_t buf_len, const char __far* format, ...) {
+    va_list val;
+    va_start(val, format);
+    uint16_t len = format_vsnprintf(buf, buf_len, format, val);
+    va_end(val);
+    return len;
+}
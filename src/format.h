@@ -0,0 +1,36 @@
+#pragma once
+/**
+ * Copyright (c) 2023 Adrian Siekierka
+ *
+ * CartFriend is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * CartFriend is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with CartFriend. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// CartFriend - lightweight string formatter
+//
+// A small subset of printf, covering the directives used by the UI and the
+// language files: %c, %s (far strings), %d, %u and %X, with an optional
+// "l" (32-bit) length modifier, field width and "0" padding flag, as well as
+// %%. tools/gen_strings.py rejects language strings using anything else.
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <wonderful.h>
+
+/**
+ * @brief Format a string into a buffer.
+ * The output is always terminated and truncated to fit buf_len.
+ * @return The number of characters written, not counting the terminator.
+ */
+uint16_t format_vsnprintf(char *buf, uint16_t buf_len, const char __far* format, va_list val);
+__attribute__((format(printf, 3, 4))) uint16_t format_snprintf(char *buf, uint16_t buf_len, const char __far* format, ...);
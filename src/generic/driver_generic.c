@@ -26,6 +26,7 @@
 #include "../driver.h"
 
 uint8_t fm_initial_slot; // TODO: remove
+uint8_t driver_hwint_mask;
 
 void driver_init(void) {
     
@@ -47,6 +48,22 @@ bool driver_read_slot(void *ptr, uint16_t slot, uint16_t bank, uint16_t offset,
     return false;
 }
 
+bool driver_read_slot_sram(uint16_t ptr, uint16_t slot, uint16_t bank, uint16_t offset, uint16_t len) __far {
+    return false;
+}
+
+bool driver_hash_slot(uint32_t *hashes, uint16_t slot, uint16_t bank, uint16_t offset, uint16_t count) __far {
+    return false;
+}
+
+bool driver_read_rom_headers(void *ptr, uint16_t slot, uint16_t bank, uint16_t count, uint16_t step) __far {
+    return false;
+}
+
+uint16_t driver_sum_slot(uint16_t *sum, uint16_t slot, uint16_t bank, uint16_t offset, uint16_t count, bool interruptible) __far {
+    return count;
+}
+
 bool driver_write_slot(const void *data, uint16_t slot, uint16_t bank, uint16_t offset, uint16_t len) __far {
     return false;
 }
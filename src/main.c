@@ -33,6 +33,7 @@
 // 0x3800 - 0x3C80: Screen 2
 // 0x3C80 - 0x3D00: Reserved (About menu sprites)
 // 0x3D00 - 0x3F00: Reserved
+// 0x4000 - 0x5000: Screen 1, pre-rendered pages (Color only)
 
 volatile uint16_t vbl_ticks;
 bool is_pcv2;
@@ -43,6 +44,9 @@ __attribute__((interrupt))
 void __far vblank_int_handler(void) {
 	vbl_ticks++;
 	vblank_input_update();
+	ui_queue_flush();
+	ui_progress_vblank();
+	ui_font_vblank();
 	ws_hwint_ack(HWINT_VBLANK);
 }
 
@@ -68,9 +72,12 @@ void main(void) {
 	driver_init();
 
 	settings_load();
+	ui_set_language(settings_local.language);
+
 	settings_refresh();
 
-    if (settings_local.flags1 & SETT_FLAGS1_UNLOCK_IEEP_NEXT_BOOT) {
+	bool unlock_ieep = settings_local.flags1 & SETT_FLAGS1_UNLOCK_IEEP_NEXT_BOOT;
+    if (unlock_ieep) {
         settings_local.flags1 &= ~SETT_FLAGS1_UNLOCK_IEEP_NEXT_BOOT;
         settings_mark_changed();
         settings_save();
@@ -78,6 +85,16 @@ void main(void) {
         outportw(IO_IEEP_CTRL, IEEP_PROTECT);
     }
 
+#ifdef USE_SLOT_SYSTEM
+	// quick resume: boot straight into the last launched software, unless
+	// a key is held or the user has asked for something else on this boot;
+	// IEEPROM is locked by now, as it is when launching from the menu
+	if ((settings_local.flags1 & SETT_FLAGS1_QUICK_RESUME) && !unlock_ieep
+		&& !settings_first_boot && ws_keypad_scan() == 0) {
+		ui_browse_quick_resume();
+	}
+#endif
+
 	input_wait_clear(); // wait for input to calm down
 
 	// keep in sync with settings.c -> settings_load for now!
@@ -103,7 +120,7 @@ void main(void) {
 #endif
 
 	while (true) {
-		ui_reset_main_screen();
+		ui_page_switch(ui_current_tab);
 
 		switch (ui_current_tab) {
 #ifdef USE_SLOT_SYSTEM
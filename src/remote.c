@@ -0,0 +1,329 @@
+/**
+ * Copyright (c) 2023 Adrian Siekierka
+ *
+ * CartFriend is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * CartFriend is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with CartFriend. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <ws.h>
+#include "catalog.h"
+#include "config.h"
+#include "driver.h"
+#include "remote.h"
+#include "serial.h"
+#include "settings.h"
+#include "sram.h"
+#include "stream.h"
+#include "ui.h"
+#include "xmodem.h"
+#include "xmodem_flash.h"
+
+#ifdef USE_SLOT_SYSTEM
+
+// Requests; the reply's payload follows the arrow.
+#define REMOTE_INFO 'i' // -> version, game slots, save blocks, launcher slot,
+                        //    active save block, settings version (LE16),
+                        //    settings size (LE16), flash banks of each save block
+#define REMOTE_LIST 'l' // slot -> slot type, name (24 bytes), catalog entries in the slot
+#define REMOTE_READ 'r' // slot, bank, offset (LE16), length (LE16) -> data
+#define REMOTE_WRITE 'w' // slot, bank, offset (LE16), data
+#define REMOTE_ERASE 'e' // slot, bank: erase the 128 KB sector of an even bank
+#define REMOTE_GET_SETTINGS 'g' // offset (LE16), length (LE16) -> data
+#define REMOTE_PUT_SETTINGS 'p' // offset (LE16), data
+#define REMOTE_SAVE_SETTINGS 's'
+#define REMOTE_MOUNT 'm' // save block to make active, or SRAM_SLOT_NONE
+#define REMOTE_LAUNCH 'b' // catalog ID
+
+// see sram_get_bank()
+#define REMOTE_SAVE_BANKS 8
+
+typedef struct {
+    uint8_t type;
+    uint16_t seq;
+    uint16_t len;
+    uint8_t data[STREAM_BLOCK_SIZE];
+} remote_reply_t;
+
+static remote_reply_t remote_reply;
+static bool remote_reply_valid;
+// slot_generation has been bumped since the catalog was last rebuilt
+static bool remote_slots_changed;
+
+static inline uint16_t remote_get16(const uint8_t *data) {
+    return data[0] | (data[1] << 8);
+}
+
+// Flash in the launcher's slot may only be changed where it holds save
+// blocks - and not the active one, whose contents in SRAM would later be
+// written back over the changes.
+static bool remote_may_change(uint8_t slot, uint8_t bank) {
+    if (slot != driver_get_launch_slot()) {
+        return true;
+    }
+    for (uint8_t i = 0; i < SRAM_SLOTS; i++) {
+        for (uint8_t j = 0; j < REMOTE_SAVE_BANKS; j++) {
+            if (sram_get_bank(i, j) == bank) {
+                return i != settings_local.active_sram_slot;
+            }
+        }
+    }
+    return false;
+}
+
+static void remote_mark_slot_changed(uint8_t slot) {
+    xmodem_flash_recv_discard();
+    if (slot != driver_get_launch_slot() && !remote_slots_changed) {
+        catalog_mark_slot_changed();
+        remote_slots_changed = true;
+    }
+}
+
+static uint8_t remote_info(void) {
+    uint16_t settings_size = sizeof(settings_t);
+    uint8_t *data = remote_reply.data;
+    *(data++) = REMOTE_VERSION;
+    *(data++) = GAME_SLOTS;
+    *(data++) = SRAM_SLOTS;
+    *(data++) = driver_get_launch_slot();
+    *(data++) = settings_local.active_sram_slot;
+    *(data++) = SETTINGS_VERSION;
+    *(data++) = SETTINGS_VERSION >> 8;
+    *(data++) = settings_size;
+    *(data++) = settings_size >> 8;
+    for (uint8_t i = 0; i < SRAM_SLOTS; i++) {
+        for (uint8_t j = 0; j < REMOTE_SAVE_BANKS; j++) {
+            *(data++) = sram_get_bank(i, j);
+        }
+    }
+    remote_reply.len = data - remote_reply.data;
+    return 0;
+}
+
+static uint8_t remote_list(const uint8_t *args, uint16_t len) {
+    const catalog_t *catalog = &settings_local.catalog;
+    if (len < 1 || args[0] >= GAME_SLOTS) {
+        return REMOTE_ERROR_ARGUMENT;
+    }
+    uint8_t slot = args[0];
+
+    catalog_refresh();
+    remote_slots_changed = false;
+
+    uint8_t *data = remote_reply.data;
+    *(data++) = settings_local.slot_type[slot];
+    memcpy(data, settings_local.slot_name[slot], sizeof(settings_local.slot_name[slot]));
+    data += sizeof(settings_local.slot_name[slot]);
+    if (catalog->count != CATALOG_COUNT_INVALID) {
+        for (uint8_t i = 0; i < catalog->count; i++) {
+            if (catalog_entry_slot(catalog->entries[i].id) == slot) {
+                memcpy(data, catalog->entries + i, sizeof(catalog_entry_t));
+                data += sizeof(catalog_entry_t);
+            }
+        }
+    }
+    remote_reply.len = data - remote_reply.data;
+    return 0;
+}
+
+static uint8_t remote_read(const uint8_t *args, uint16_t len) {
+    if (len < 6) {
+        return REMOTE_ERROR_ARGUMENT;
+    }
+    uint8_t slot = args[0];
+    uint8_t bank = args[1];
+    uint16_t offset = remote_get16(args + 2);
+    uint16_t count = remote_get16(args + 4);
+    if (slot >= GAME_SLOTS || count > STREAM_BLOCK_SIZE || ((uint32_t) offset + count) > 0x10000) {
+        return REMOTE_ERROR_ARGUMENT;
+    }
+    driver_unlock();
+    bool result = driver_read_slot(remote_reply.data, slot, bank, offset, count);
+    driver_lock();
+    if (!result) {
+        return REMOTE_ERROR_FLASH;
+    }
+    remote_reply.len = count;
+    return 0;
+}
+
+static uint8_t remote_write(const uint8_t *args, uint16_t len) {
+    if (len < 4) {
+        return REMOTE_ERROR_ARGUMENT;
+    }
+    uint8_t slot = args[0];
+    uint8_t bank = args[1];
+    uint16_t offset = remote_get16(args + 2);
+    uint16_t count = len - 4;
+    if (slot >= GAME_SLOTS || ((uint32_t) offset + count) > 0x10000) {
+        return REMOTE_ERROR_ARGUMENT;
+    }
+    if (!remote_may_change(slot, bank)) {
+        return REMOTE_ERROR_PROTECTED;
+    }
+    remote_mark_slot_changed(slot);
+    if (count != 0) {
+        driver_unlock();
+        bool result = driver_write_slot(args + 4, slot, bank, offset, count);
+        driver_lock();
+        if (!result) {
+            return REMOTE_ERROR_FLASH;
+        }
+    }
+    return 0;
+}
+
+static uint8_t remote_erase(const uint8_t *args, uint16_t len) {
+    if (len < 2 || args[0] >= GAME_SLOTS || (args[1] & 1)) {
+        return REMOTE_ERROR_ARGUMENT;
+    }
+    uint8_t slot = args[0];
+    uint8_t bank = args[1];
+    if (!remote_may_change(slot, bank) || !remote_may_change(slot, bank + 1)) {
+        return REMOTE_ERROR_PROTECTED;
+    }
+    remote_mark_slot_changed(slot);
+    driver_unlock();
+    bool result = driver_erase_bank(0, slot, bank);
+    driver_lock();
+    return result ? 0 : REMOTE_ERROR_FLASH;
+}
+
+static uint8_t remote_get_settings(const uint8_t *args, uint16_t len) {
+    if (len < 4) {
+        return REMOTE_ERROR_ARGUMENT;
+    }
+    uint16_t offset = remote_get16(args);
+    uint16_t count = remote_get16(args + 2);
+    if (count > STREAM_BLOCK_SIZE || ((uint32_t) offset + count) > sizeof(settings_t)) {
+        return REMOTE_ERROR_ARGUMENT;
+    }
+    memcpy(remote_reply.data, ((const uint8_t*) &settings_local) + offset, count);
+    remote_reply.len = count;
+    return 0;
+}
+
+// The magic and version cannot be changed. Neither can the active save
+// block, which has to match the contents of SRAM (see REMOTE_MOUNT), nor
+// the launcher's slot, whatever the settings were copied from.
+static uint8_t remote_put_settings(const uint8_t *args, uint16_t len) {
+    if (len < 2) {
+        return REMOTE_ERROR_ARGUMENT;
+    }
+    uint16_t offset = remote_get16(args);
+    uint16_t count = len - 2;
+    if (offset < offsetof(settings_t, slot_type) || ((uint32_t) offset + count) > sizeof(settings_t)) {
+        return REMOTE_ERROR_ARGUMENT;
+    }
+
+    uint8_t active_sram_slot = settings_local.active_sram_slot;
+    memcpy(((uint8_t*) &settings_local) + offset, args + 2, count);
+    settings_local.active_sram_slot = active_sram_slot;
+    for (uint8_t i = 0; i < GAME_SLOTS; i++) {
+        if (i == driver_get_launch_slot()) {
+            settings_local.slot_type[i] = SLOT_TYPE_LAUNCHER;
+        } else if (settings_local.slot_type[i] == SLOT_TYPE_LAUNCHER) {
+            settings_local.slot_type[i] = SLOT_TYPE_SOFT;
+        }
+    }
+    if (offset < offsetof(settings_t, catalog) + sizeof(catalog_t) && offset + count > offsetof(settings_t, catalog)) {
+        catalog_invalidate();
+    }
+    settings_mark_changed();
+    return 0;
+}
+
+static uint8_t remote_mount(const uint8_t *args, uint16_t len) {
+    if (len < 1 || (args[0] >= SRAM_SLOTS && args[0] != SRAM_SLOT_NONE)) {
+        return REMOTE_ERROR_ARGUMENT;
+    }
+    sram_switch_to_slot(args[0]);
+    return 0;
+}
+
+static uint8_t remote_launch(const uint8_t *args, uint16_t len, uint8_t *launch) {
+    uint8_t rom_header[16];
+    if (len < 1 || catalog_entry_slot(args[0]) == driver_get_launch_slot()) {
+        return REMOTE_ERROR_ARGUMENT;
+    }
+    _nmemset(rom_header, 0xFF, sizeof(rom_header));
+    driver_unlock();
+    catalog_read_rom_header(rom_header, args[0]);
+    driver_lock();
+    if (!catalog_is_valid_rom_header(rom_header)) {
+        return REMOTE_ERROR_ARGUMENT;
+    }
+    *launch = args[0];
+    return 0;
+}
+
+static void remote_handle(const stream_frame_t *request, uint8_t *launch) {
+    uint8_t error;
+
+    remote_reply.type = request->type;
+    remote_reply.seq = request->seq;
+    remote_reply.len = 0;
+
+    switch (request->type) {
+    case REMOTE_INFO: error = remote_info(); break;
+    case REMOTE_LIST: error = remote_list(request->data, request->len); break;
+    case REMOTE_READ: error = remote_read(request->data, request->len); break;
+    case REMOTE_WRITE: error = remote_write(request->data, request->len); break;
+    case REMOTE_ERASE: error = remote_erase(request->data, request->len); break;
+    case REMOTE_GET_SETTINGS: error = remote_get_settings(request->data, request->len); break;
+    case REMOTE_PUT_SETTINGS: error = remote_put_settings(request->data, request->len); break;
+    case REMOTE_SAVE_SETTINGS: settings_save(); error = 0; break;
+    case REMOTE_MOUNT: error = remote_mount(request->data, request->len); break;
+    case REMOTE_LAUNCH: error = remote_launch(request->data, request->len, launch); break;
+    default: error = REMOTE_ERROR_COMMAND; break;
+    }
+
+    if (error != 0) {
+        remote_reply.type = REMOTE_NAK;
+        remote_reply.data[0] = error;
+        remote_reply.len = 1;
+    }
+}
+
+uint8_t remote_run(void) {
+    uint8_t launch = REMOTE_NO_LAUNCH;
+
+    remote_reply_valid = false;
+    remote_slots_changed = false;
+    // keep the serial buffers going while flash is being accessed
+    driver_hwint_mask = HWINT_SERIAL_RX | HWINT_SERIAL_TX;
+
+    while (launch == REMOTE_NO_LAUNCH && !xmodem_poll_exit()) {
+        const stream_frame_t *request = stream_read_frame();
+        if (request == NULL) {
+            cpu_halt();
+            continue;
+        }
+        if (!remote_reply_valid || request->seq != remote_reply.seq) {
+            ui_step_work_indicator();
+            remote_handle(request, &launch);
+            remote_reply_valid = true;
+        }
+        stream_write_frame(remote_reply.type, remote_reply.seq, remote_reply.data, remote_reply.len);
+    }
+    serial_flush_buffered();
+
+    driver_hwint_mask = 0;
+    return launch;
+}
+
+#endif
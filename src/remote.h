@@ -0,0 +1,54 @@
+#pragma once
+/**
+ * Copyright (c) 2023 Adrian Siekierka
+ *
+ * CartFriend is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * CartFriend is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with CartFriend. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// CartFriend - serial command server
+//
+// Lets a host script manage the cartridge over the EXT port: list slots,
+// read, write and erase flash, get and put settings, switch the active save
+// block and launch software. Requests and replies are frames as used by the
+// streaming protocol (see stream.h); the reference client is
+// tools/cf_remote.py, which documents the commands.
+//
+// Every request is answered with a frame of the same type and sequence
+// number, or a REMOTE_NAK frame holding an error code. A request repeating
+// the sequence number of the previous one is not carried out again; the
+// previous reply is sent again instead, so that the host can safely retry
+// requests whose reply was lost.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wonderful.h>
+
+#define REMOTE_VERSION 1
+
+#define REMOTE_NAK 'N'
+
+#define REMOTE_ERROR_COMMAND 1 // unknown command
+#define REMOTE_ERROR_ARGUMENT 2 // invalid arguments
+#define REMOTE_ERROR_PROTECTED 3 // the flash area may not be changed
+#define REMOTE_ERROR_FLASH 4 // the flash driver failed
+
+#define REMOTE_NO_LAUNCH 0xFF
+
+/**
+ * @brief Answer requests until B is pressed, or the host asks for software
+ * to be launched.
+ * The serial port must have been opened with xmodem_open_buffered().
+ * @return The catalog ID of the software to launch, or REMOTE_NO_LAUNCH.
+ */
+uint8_t remote_run(void);
@@ -1,25 +1,36 @@
+#include <stdbool.h>
 #include <stdint.h>
 #include <ws.h>
 #include "serial.h"
 
-#define SERIAL_TXBUF_SIZE 128
+// both must be 256, so that the indices wrap around on their own
+#define SERIAL_TXBUF_SIZE 256
+#define SERIAL_RXBUF_SIZE 256
 
 uint8_t serial_txbuf[SERIAL_TXBUF_SIZE];
-uint8_t serial_txbuf_pos = 0, serial_txbuf_len = 0;
+volatile uint8_t serial_txbuf_pos = 0, serial_txbuf_len = 0;
 
-__attribute__((interrupt))
-static void serial_txbuf_int_handler(void) __far {
-    if (serial_txbuf_pos != serial_txbuf_len) {
-        ws_serial_putc(serial_txbuf[serial_txbuf_pos]);
-        serial_txbuf_pos = (serial_txbuf_pos + 1) & (SERIAL_TXBUF_SIZE - 1);
-    }
-    if (serial_txbuf_pos == serial_txbuf_len) {
-        ws_hwint_disable(HWINT_SERIAL_TX);
-    }
-}
+uint8_t serial_rxbuf[SERIAL_RXBUF_SIZE];
+volatile uint8_t serial_rxbuf_pos = 0, serial_rxbuf_len = 0;
+volatile bool serial_rxbuf_overflow = false;
+
+// serial_asm.s
+extern void serial_txbuf_int_handler(void) __far;
+extern void serial_rxbuf_int_handler(void) __far;
 
 void serial_init_buffered(void) {
     ws_hwint_set_handler(HWINT_IDX_SERIAL_TX, serial_txbuf_int_handler);
+    ws_hwint_set_handler(HWINT_IDX_SERIAL_RX, serial_rxbuf_int_handler);
+    serial_rxbuf_pos = 0;
+    serial_rxbuf_len = 0;
+    serial_rxbuf_overflow = false;
+    ws_hwint_enable(HWINT_SERIAL_RX);
+}
+
+void serial_close_buffered(void) {
+    serial_flush_buffered();
+    ws_hwint_disable(HWINT_SERIAL_RX);
+    ws_hwint_set_default_handler_serial_rx();
 }
 
 void serial_flush_buffered(void) {
@@ -30,10 +41,43 @@ void serial_flush_buffered(void) {
 
 void serial_putc_buffered(uint8_t value) {
     serial_txbuf[serial_txbuf_len] = value;
-    uint8_t next_len = (serial_txbuf_len + 1) & (SERIAL_TXBUF_SIZE - 1);
+    uint8_t next_len = serial_txbuf_len + 1;
     while (next_len == serial_txbuf_pos) {
         cpu_halt();
     }
     serial_txbuf_len = next_len;
     ws_hwint_enable(HWINT_SERIAL_TX);
 }
+
+uint8_t serial_available_buffered(void) {
+    return serial_rxbuf_len - serial_rxbuf_pos;
+}
+
+int16_t serial_getc_buffered(void) {
+    uint8_t pos = serial_rxbuf_pos;
+    if (pos == serial_rxbuf_len) {
+        return -1;
+    }
+    uint8_t value = serial_rxbuf[pos];
+    serial_rxbuf_pos = pos + 1;
+    return value;
+}
+
+uint16_t serial_read_buffered(uint8_t __far* dest, uint16_t len) {
+    uint16_t i = 0;
+    uint8_t pos = serial_rxbuf_pos;
+    // serial_rxbuf_len may grow while copying; anything past the snapshot
+    // is picked up by the next call
+    uint8_t end = serial_rxbuf_len;
+    while (i < len && pos != end) {
+        dest[i++] = serial_rxbuf[pos++];
+    }
+    serial_rxbuf_pos = pos;
+    return i;
+}
+
+bool serial_overflow_buffered(void) {
+    bool result = serial_rxbuf_overflow;
+    serial_rxbuf_overflow = false;
+    return result;
+}
@@ -17,8 +17,37 @@
  * with CartFriend. If not, see <https://www.gnu.org/licenses/>. 
  */
 
+#include <stdbool.h>
 #include <stdint.h>
 
+/**
+ * @brief Install the buffered transmit and receive interrupt handlers.
+ * Call after opening the serial port. From then on, incoming bytes must be
+ * read with the *_buffered functions below, not with ws_serial_getc().
+ */
 void serial_init_buffered(void);
+/**
+ * @brief Flush pending output and restore the default receive handler.
+ */
+void serial_close_buffered(void);
 void serial_flush_buffered(void);
 void serial_putc_buffered(uint8_t value);
+
+/**
+ * @return The number of received bytes waiting in the buffer.
+ */
+uint8_t serial_available_buffered(void);
+/**
+ * @return The next received byte, or -1 if none is waiting. Does not block.
+ */
+int16_t serial_getc_buffered(void);
+/**
+ * @brief Copy up to len received bytes to dest. Does not block.
+ * @return The number of bytes copied.
+ */
+uint16_t serial_read_buffered(uint8_t __far* dest, uint16_t len);
+/**
+ * @return true if received bytes were dropped since the last call, because
+ * the buffer was full.
+ */
+bool serial_overflow_buffered(void);
@@ -0,0 +1,101 @@
+/**
+ * Copyright (c) 2023 Adrian Siekierka
+ *
+ * CartFriend is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * CartFriend is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with CartFriend. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <wonderful.h>
+
+	.arch	i186
+	.code16
+	.intel_syntax noprefix
+
+	// The buffered serial handlers live in RAM, so that they can keep
+	// running while the flash driver has the cartridge ROM switched away
+	// (see driver_hwint_mask).
+	.section .data
+	.global serial_txbuf_int_handler
+	.align 2
+serial_txbuf_int_handler:
+	push	ax
+	push	bx
+	push	ds
+	xor	ax, ax
+	mov	ds, ax
+	xor	bh, bh
+
+	// the interrupt only fires once the UART can take another byte
+	mov	bl, [serial_txbuf_pos]
+	cmp	bl, [serial_txbuf_len]
+	je	serial_txbuf_int_handler_empty
+	mov	al, [serial_txbuf + bx]
+	out	0xB1, al
+	inc	bl
+	mov	[serial_txbuf_pos], bl
+	cmp	bl, [serial_txbuf_len]
+	jne	serial_txbuf_int_handler_done
+
+serial_txbuf_int_handler_empty:
+	// nothing left to send; disable HWINT_SERIAL_TX
+	in	al, 0xB2
+	and	al, 0xFE
+	out	0xB2, al
+
+serial_txbuf_int_handler_done:
+	pop	ds
+	pop	bx
+	pop	ax
+	iret
+
+	.global serial_rxbuf_int_handler
+	.align 2
+serial_rxbuf_int_handler:
+	push	ax
+	push	bx
+	push	ds
+	xor	ax, ax
+	mov	ds, ax
+	xor	bh, bh
+
+serial_rxbuf_int_handler_loop:
+	in	al, 0xB3
+	test	al, 0x02
+	jnz	serial_rxbuf_int_handler_overrun
+	test	al, 0x01
+	jz	serial_rxbuf_int_handler_done
+	in	al, 0xB1
+
+	// the byte is stored in the free slot at serial_rxbuf_len either way,
+	// but only kept if the buffer does not become full
+	mov	bl, [serial_rxbuf_len]
+	mov	[serial_rxbuf + bx], al
+	inc	bl
+	cmp	bl, [serial_rxbuf_pos]
+	je	serial_rxbuf_int_handler_full
+	mov	[serial_rxbuf_len], bl
+	jmp	serial_rxbuf_int_handler_loop
+
+serial_rxbuf_int_handler_overrun:
+	// a byte was lost in the UART itself; reset the overrun flag
+	or	al, 0x20
+	out	0xB3, al
+serial_rxbuf_int_handler_full:
+	mov	byte ptr [serial_rxbuf_overflow], 1
+	jmp	serial_rxbuf_int_handler_loop
+
+serial_rxbuf_int_handler_done:
+	pop	ds
+	pop	bx
+	pop	ax
+	iret
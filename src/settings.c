@@ -65,11 +65,16 @@ void settings_reset(void) {
     }
     settings_local.active_sram_slot = SRAM_SLOT_FIRST_BOOT;
     settings_local.color_theme = 0x02;
+    settings_local.catalog.count = CATALOG_COUNT_INVALID;
+    _nmemset(settings_local.recent, RECENT_NONE, sizeof(settings_local.recent));
 
     settings_slot = 127;
     settings_changed = true;
 }
 
+// settings are stored in 1 KB records, the last two bytes of which hold the CRC
+_Static_assert(sizeof(settings_t) <= 1022, "settings_t does not fit a settings record");
+
 static inline uint16_t settings_calculate_crc(void) {
     return crc16((const char*) &settings_local, sizeof(settings_local), 1022);
 }
@@ -100,6 +105,22 @@ static void settings_migrate(void) {
         settings_local.language = 0;
     }
 
+    if (settings_local.version < 6) {
+        settings_local.slot_generation = 0;
+        settings_local.catalog.count = CATALOG_COUNT_INVALID;
+    }
+
+    if (settings_local.version < 7) {
+        // catalog entries gained verification flags
+        settings_local.catalog.count = CATALOG_COUNT_INVALID;
+    }
+
+    if (settings_local.version < 9) {
+        // the catalog grew, moving the recently launched list
+        settings_local.catalog.count = CATALOG_COUNT_INVALID;
+        _nmemset(settings_local.recent, RECENT_NONE, sizeof(settings_local.recent));
+    }
+
     settings_local.version = SETTINGS_VERSION;
 }
 
@@ -200,6 +221,17 @@ void settings_mark_changed(void) {
     ui_update_indicators();
 }
 
+void settings_mark_launched(uint8_t id) {
+    uint8_t i;
+    for (i = 0; i < RECENT_MAX - 1; i++) {
+        if (settings_local.recent[i] == id) break;
+    }
+    if (i == 0) return;
+    memmove(settings_local.recent + 1, settings_local.recent, i);
+    settings_local.recent[0] = id;
+    settings_mark_changed();
+}
+
 void settings_save(void) {
 #ifdef USE_SLOT_SYSTEM
     if (!settings_changed) return;
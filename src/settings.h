@@ -18,6 +18,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include "catalog.h"
 #include "config.h"
 
 #define SLOT_TYPE_SOFT 0
@@ -26,7 +27,10 @@
 #define SLOT_TYPE_APPENDED_FILES 3 /* Tentative */
 #define SLOT_TYPE_UNUSED 0xFF
 
-#define SETTINGS_VERSION 5
+#define SETTINGS_VERSION 9
+
+#define RECENT_MAX 16
+#define RECENT_NONE 0xFF
 
 #define SRAM_SLOT_ALL 0xFD
 #define SRAM_SLOT_FIRST_BOOT 0xFE
@@ -48,6 +52,10 @@ typedef struct __attribute__((packed)) {
 
 	uint8_t flags1; // 424
 	uint8_t language; // 425
+
+	uint8_t slot_generation; // 426
+	catalog_t catalog; // 1005
+	uint8_t recent[RECENT_MAX]; // 1021, catalog entry IDs, most recently launched first
 } settings_t;
 
 #define SETT_FLAGS1_HIDE_SLOT_IDS 0x01
@@ -56,6 +64,7 @@ typedef struct __attribute__((packed)) {
 #define SETT_FLAGS1_SERIAL_9600BPS 0x08
 #define SETT_FLAGS1_WIDE_SCREEN 0x10
 #define SETT_FLAGS1_FORCE_FAST_SRAM 0x20
+#define SETT_FLAGS1_QUICK_RESUME 0x40
 
 extern settings_t settings_local;
 extern bool settings_changed;
@@ -65,4 +74,5 @@ void settings_reset(void);
 void settings_load(void);
 void settings_refresh(void);
 void settings_mark_changed(void);
+void settings_mark_launched(uint8_t id);
 void settings_save(void);
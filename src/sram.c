@@ -28,13 +28,14 @@
 #include "sram.h"
 #include "ui.h"
 #include "util.h"
+#include "xmodem_flash.h"
 
 #ifdef USE_SLOT_SYSTEM
 #define USE_PARTIAL_WRITES
 
 bool sram_ui_quiet = false;
 
-static inline uint8_t sram_get_bank(uint8_t sram_slot, uint16_t sub_bank) {
+uint8_t sram_get_bank(uint8_t sram_slot, uint16_t sub_bank) {
     uint8_t slot = 0x80 + (sram_slot << 3);
     uint8_t bank = slot + sub_bank;
     // carve out a settings area between F40000 .. F5FFFF
@@ -63,10 +64,11 @@ static void sram_backup_restore_slot(uint8_t sram_slot, bool is_restore) {
     if (!sram_ui_quiet) {
         ui_reset_main_screen();
         if (settings_location_legacy) {
-            ui_puts_centered(false, 2, 0, lang_keys[LK_UI_MSG_MIGRATING]);
+            ui_puts_centered(false, 2, 0, lang_get(LK_UI_MSG_MIGRATING));
         } else {
-            ui_puts_centered(false, 2, 0, lang_keys[is_restore ? LK_UI_MSG_RESTORE_SRAM : LK_UI_MSG_BACKUP_SRAM]);
+            ui_puts_centered(false, 2, 0, lang_get(is_restore ? LK_UI_MSG_RESTORE_SRAM : LK_UI_MSG_BACKUP_SRAM));
         }
+        ui_pbar_show(&pbar);
     }
 
     if (_CS >= 0x2000) {
@@ -74,9 +76,6 @@ static void sram_backup_restore_slot(uint8_t sram_slot, bool is_restore) {
             pbar.step_max = 256;
             for (uint16_t i = 0; i < 256; i++) {
                 pbar.step = i;
-                if (!sram_ui_quiet) {
-                    ui_pbar_draw(&pbar);
-                }
                 ui_step_work_indicator();
 
                 if (!(i & 31)) {
@@ -103,15 +102,10 @@ static void sram_backup_restore_slot(uint8_t sram_slot, bool is_restore) {
             uint8_t bank;
             for (uint16_t i = 0; i < 2048; i++) {
                 pbar.step = i;
-                if (!(i & 7)) {
-                    if (!sram_ui_quiet) {
-                        ui_pbar_draw(&pbar);
-                    }
-                    if (!(i & 255)) {
-                        outportb(IO_BANK_RAM, i >> 8);
-                        asm volatile("" ::: "memory");
-                        bank = sram_get_bank(sram_slot, i >> 8);
-                    }
+                if (!(i & 255)) {
+                    outportb(IO_BANK_RAM, i >> 8);
+                    asm volatile("" ::: "memory");
+                    bank = sram_get_bank(sram_slot, i >> 8);
                 }
                 ui_step_work_indicator();
 
@@ -130,14 +124,17 @@ static void sram_backup_restore_slot(uint8_t sram_slot, bool is_restore) {
         }
     }
 
+    ui_pbar_hide(&pbar);
     ui_clear_work_indicator();
     ui_update_indicators();
 }
 
 void sram_erase(uint8_t sram_slot) {
+    xmodem_flash_recv_discard();
+
     if (!sram_ui_quiet) {
         ui_reset_main_screen();
-        ui_puts_centered(false, 2, 0, lang_keys[LK_UI_MSG_ERASE_SRAM]);
+        ui_puts_centered(false, 2, 0, lang_get(LK_UI_MSG_ERASE_SRAM));
     }
 
     ui_pbar_state_t pbar = {
@@ -149,10 +146,10 @@ void sram_erase(uint8_t sram_slot) {
     if (sram_slot == SRAM_SLOT_NONE) {
         pbar.step_max = 128;
         ui_pbar_init(&pbar);
+        if (!sram_ui_quiet) ui_pbar_show(&pbar);
 
         for (uint16_t i = 0; i < 128; i++) { /* 16 * 8 */
             pbar.step = i;
-            if (!sram_ui_quiet) ui_pbar_draw(&pbar);
             ui_step_work_indicator();
 
             ws_bank_ram_set(i >> 4);
@@ -164,12 +161,12 @@ void sram_erase(uint8_t sram_slot) {
     } else if (sram_slot == SRAM_SLOT_ALL) {
         pbar.step_max = 8 * SRAM_SLOTS;
         ui_pbar_init(&pbar);
+        if (!sram_ui_quiet) ui_pbar_show(&pbar);
 
         uint8_t driver_slot = driver_get_launch_slot();
 
         for (uint8_t i = 0; i < pbar.step_max; i++) {
             pbar.step = i;
-            if (!sram_ui_quiet) ui_pbar_draw(&pbar);
             ui_step_work_indicator();
 
             uint8_t rom_slot = sram_get_bank(i >> 3, i & 7);
@@ -178,12 +175,12 @@ void sram_erase(uint8_t sram_slot) {
     } else {
         pbar.step_max = 8;
         ui_pbar_init(&pbar);
+        if (!sram_ui_quiet) ui_pbar_show(&pbar);
 
         uint8_t driver_slot = driver_get_launch_slot();
 
         for (uint8_t i = 0; i < 8; i++) {
             pbar.step = i;
-            if (!sram_ui_quiet) ui_pbar_draw(&pbar);
             ui_step_work_indicator();
 
             uint8_t rom_slot = sram_get_bank(sram_slot, i);
@@ -191,6 +188,7 @@ void sram_erase(uint8_t sram_slot) {
         }
     }
 
+    ui_pbar_hide(&pbar);
     ui_update_indicators();
 }
 
@@ -213,6 +211,8 @@ void sram_switch_to_slot(uint8_t sram_slot) {
     }
 
     if (settings_local.active_sram_slot < SRAM_SLOTS) {
+        // an interrupted save import could be written over
+        xmodem_flash_recv_discard();
         sram_backup_restore_slot(settings_local.active_sram_slot, false);
         settings_local.active_sram_slot = SRAM_SLOT_NONE;
         settings_mark_changed();
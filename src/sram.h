@@ -29,5 +29,10 @@ static inline void sram_enable_fast(void) {
 static inline void sram_disable_fast(void) {
     outportb(IO_SYSTEM_CTRL2, inportb(IO_SYSTEM_CTRL2) | (SYSTEM_CTRL2_SRAM_WAIT | SYSTEM_CTRL2_CART_IO_WAIT));
 }
+/**
+ * @return The flash bank in the launcher's slot which holds the given 64 KB
+ * bank of a save block.
+ */
+uint8_t sram_get_bank(uint8_t sram_slot, uint16_t sub_bank);
 void sram_erase(uint8_t sram_slot);
 void sram_switch_to_slot(uint8_t sram_slot);
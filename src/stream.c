@@ -0,0 +1,328 @@
+/**
+ * Copyright (c) 2023 Adrian Siekierka
+ *
+ * CartFriend is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * CartFriend is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with CartFriend. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <ws.h>
+#include "serial.h"
+#include "stream.h"
+#include "xmodem.h"
+
+// Frame layout: STREAM_SYNC, type, seq (LE), payload length (LE), payload,
+// CRC-16 of type to payload (BE, as in XMODEM).
+// seq = version, payload = size (LE32); from the host, optionally followed
+// by flags; from the cartridge, optionally followed by the block count
+// (LE16) and CRC (LE16) of a transfer to resume
+#define STREAM_HELLO 'H'
+#define STREAM_DATA 'D' // seq = block
+#define STREAM_ACK 'A' // seq = base, payload = limit (LE16), received (LE32)
+#define STREAM_END 'E' // seq = block count; echoed by the receiver
+#define STREAM_CANCEL 'X'
+
+#define STREAM_VERSION 1
+// the host can resume interrupted transfers
+#define STREAM_HELLO_RESUME 0x01
+#define STREAM_HEADER_SIZE 5
+// in VBlanks; the sender repeats its oldest unacknowledged block, or the
+// receiver its acknowledgement, after this long without progress
+#define STREAM_TIMEOUT 75
+#define STREAM_RETRIES 10
+
+extern volatile uint16_t vbl_ticks;
+
+static stream_frame_t stream_rx;
+// number of bytes of stream_rx received, plus one for the sync byte
+static uint16_t stream_rx_pos;
+static uint32_t stream_hello_size;
+static stream_resume_t stream_hello_resume;
+
+static inline uint16_t stream_get16(const uint8_t *data) {
+    return data[0] | (data[1] << 8);
+}
+
+static inline uint32_t stream_get32(const uint8_t *data) {
+    return stream_get16(data) | ((uint32_t) stream_get16(data + 2) << 16);
+}
+
+// Collect incoming bytes; returns true once a frame with a valid CRC is in
+// stream_rx. Anything else is skipped until the next sync byte.
+static bool stream_poll(void) {
+    int16_t r;
+    while ((r = serial_getc_buffered()) >= 0) {
+        if (stream_rx_pos == 0) {
+            if (r == STREAM_SYNC) stream_rx_pos = 1;
+            continue;
+        }
+        ((uint8_t*) &stream_rx)[stream_rx_pos - 1] = r;
+        stream_rx_pos++;
+        if (stream_rx_pos <= STREAM_HEADER_SIZE) {
+            continue;
+        }
+        if (stream_rx.len > STREAM_BLOCK_SIZE) {
+            stream_rx_pos = 0;
+            continue;
+        }
+        if (stream_rx_pos == 1 + STREAM_HEADER_SIZE + stream_rx.len + 2) {
+            stream_rx_pos = 0;
+            uint16_t crc = (stream_rx.data[stream_rx.len] << 8) | stream_rx.data[stream_rx.len + 1];
+            if (xmodem_crc16(0, (const uint8_t*) &stream_rx, STREAM_HEADER_SIZE + stream_rx.len) == crc) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+const stream_frame_t *stream_read_frame(void) {
+    return stream_poll() ? &stream_rx : NULL;
+}
+
+void stream_write_frame(uint8_t type, uint16_t seq, const uint8_t *data, uint16_t len) {
+    uint8_t header[STREAM_HEADER_SIZE] = {type, seq, seq >> 8, len, len >> 8};
+    uint16_t crc = xmodem_crc16(0, header, STREAM_HEADER_SIZE);
+    crc = xmodem_crc16(crc, data, len);
+
+    serial_putc_buffered(STREAM_SYNC);
+    for (uint8_t i = 0; i < STREAM_HEADER_SIZE; i++) {
+        serial_putc_buffered(header[i]);
+    }
+    for (uint16_t i = 0; i < len; i++) {
+        serial_putc_buffered(data[i]);
+    }
+    serial_putc_buffered(crc >> 8);
+    serial_putc_buffered(crc);
+}
+
+static void stream_write_hello(void) {
+    uint32_t size = stream_hello_size;
+    uint16_t block = stream_hello_resume.block;
+    uint16_t crc = stream_hello_resume.crc;
+    uint8_t data[8] = {size, size >> 8, size >> 16, size >> 24, block, block >> 8, crc, crc >> 8};
+    stream_write_frame(STREAM_HELLO, STREAM_VERSION, data, block != 0 ? 8 : 4);
+}
+
+static void stream_write_ack(uint16_t base, uint16_t limit, uint32_t received) {
+    uint8_t data[6] = {limit, limit >> 8, received, received >> 8, received >> 16, received >> 24};
+    stream_write_frame(STREAM_ACK, base, data, sizeof(data));
+}
+
+uint8_t stream_cancel(uint8_t result) {
+    stream_write_frame(STREAM_CANCEL, 0, NULL, 0);
+    serial_flush_buffered();
+    return result;
+}
+
+uint8_t stream_accept(uint32_t size, uint32_t *host_size, stream_resume_t *resume) {
+    uint16_t start = vbl_ticks;
+
+    // the sync byte has been read by the XMODEM code already
+    stream_rx_pos = 1;
+    while (!stream_poll()) {
+        if (xmodem_poll_exit()) return XMODEM_SELF_CANCEL;
+        // the host repeats its greeting every STREAM_TIMEOUT
+        if (((uint16_t) (vbl_ticks - start)) > STREAM_TIMEOUT * 3) {
+            return XMODEM_ERROR;
+        }
+        cpu_halt();
+    }
+    if (stream_rx.type != STREAM_HELLO || stream_rx.seq != STREAM_VERSION || stream_rx.len < 4) {
+        return stream_cancel(XMODEM_ERROR);
+    }
+    if (host_size != NULL) {
+        *host_size = stream_get32(stream_rx.data);
+    }
+
+    stream_hello_resume.block = 0;
+    if (resume != NULL) {
+        if (resume->block != 0 && stream_rx.len >= 5 && (stream_rx.data[4] & STREAM_HELLO_RESUME)
+            && stream_get32(stream_rx.data) == resume->size) {
+            stream_hello_resume = *resume;
+        } else {
+            resume->block = 0;
+        }
+    }
+
+    stream_hello_size = size;
+    stream_write_hello();
+    return XMODEM_OK;
+}
+
+uint8_t stream_send(const stream_t *stream) {
+    uint8_t data[STREAM_BLOCK_SIZE];
+    uint16_t count = (stream->size + STREAM_BLOCK_SIZE - 1) / STREAM_BLOCK_SIZE;
+    uint16_t base = 0, next = 0;
+    // nothing may be sent before the receiver's first acknowledgement
+    uint16_t limit = 0;
+    // bit i: block base + i has been received, or sent again since the
+    // last timeout, respectively
+    uint32_t received = 0, resent = 0;
+    uint16_t progress_ticks = vbl_ticks;
+    uint8_t retries = STREAM_RETRIES;
+
+    while (base < count) {
+        if (xmodem_poll_exit()) return stream_cancel(XMODEM_SELF_CANCEL);
+
+        uint16_t block = 0xFFFF;
+        if (stream_poll()) {
+            if (stream_rx.type == STREAM_CANCEL) {
+                return XMODEM_CANCEL;
+            } else if (stream_rx.type == STREAM_HELLO) {
+                // our greeting was lost
+                stream_write_hello();
+            } else if (stream_rx.type == STREAM_ACK && stream_rx.len >= 6
+                && stream_rx.seq >= base && stream_rx.seq <= next) {
+                uint16_t shift = stream_rx.seq - base;
+                if (shift != 0) {
+                    base = stream_rx.seq;
+                    resent = shift < 32 ? (resent >> shift) : 0;
+                    progress_ticks = vbl_ticks;
+                    retries = STREAM_RETRIES;
+                }
+                limit = stream_get16(stream_rx.data);
+                received = stream_get32(stream_rx.data + 2);
+
+                // a block missing below one which has been received was
+                // lost; send the lowest such block again, once
+                if (received) {
+                    uint32_t below = received;
+                    below |= below >> 1;
+                    below |= below >> 2;
+                    below |= below >> 4;
+                    below |= below >> 8;
+                    below |= below >> 16;
+                    uint32_t lost = (below >> 1) & ~(received | resent);
+                    for (uint8_t i = 0; lost; i++, lost >>= 1) {
+                        if (lost & 1) {
+                            block = base + i;
+                            resent |= ((uint32_t) 1) << i;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+
+        if (block == 0xFFFF && base < next && ((uint16_t) (vbl_ticks - progress_ticks)) > STREAM_TIMEOUT) {
+            if ((retries--) == 0) return stream_cancel(XMODEM_ERROR);
+            // nothing has been acknowledged in a while; start over from the
+            // oldest block
+            block = base;
+            resent = 1;
+            progress_ticks = vbl_ticks;
+        }
+        if (block == 0xFFFF && next < count && next < limit && next < base + STREAM_WINDOW) {
+            block = next++;
+        }
+
+        if (block != 0xFFFF) {
+            uint16_t len = stream->load(stream->userdata, block, data);
+            stream_write_frame(STREAM_DATA, block, data, len);
+        } else {
+            cpu_halt();
+        }
+    }
+
+    for (retries = STREAM_RETRIES; retries > 0; retries--) {
+        stream_write_frame(STREAM_END, count, NULL, 0);
+        uint16_t start = vbl_ticks;
+        while (((uint16_t) (vbl_ticks - start)) <= STREAM_TIMEOUT) {
+            if (xmodem_poll_exit()) return stream_cancel(XMODEM_SELF_CANCEL);
+            if (stream_poll()) {
+                if (stream_rx.type == STREAM_CANCEL) {
+                    return XMODEM_CANCEL;
+                } else if (stream_rx.type == STREAM_END && stream_rx.seq == count) {
+                    return XMODEM_OK;
+                }
+            } else {
+                cpu_halt();
+            }
+        }
+    }
+    return XMODEM_ERROR;
+}
+
+uint8_t stream_recv(const stream_t *stream) {
+    uint16_t base = stream->start, limit;
+    // bit i: block base + i has been received
+    uint32_t received = 0;
+    uint16_t rx_ticks;
+    uint8_t retries = STREAM_RETRIES;
+
+    if (!stream->advance(stream->userdata, base, &limit)) {
+        return stream_cancel(XMODEM_ERROR);
+    }
+    stream_write_ack(base, limit, received);
+    rx_ticks = vbl_ticks;
+
+    while (true) {
+        if (xmodem_poll_exit()) return stream_cancel(XMODEM_SELF_CANCEL);
+
+        if (!stream_poll()) {
+            if (((uint16_t) (vbl_ticks - rx_ticks)) > STREAM_TIMEOUT) {
+                // the sender may be waiting for a lost acknowledgement
+                if ((retries--) == 0) return stream_cancel(XMODEM_ERROR);
+                stream_write_ack(base, limit, received);
+                rx_ticks = vbl_ticks;
+            } else {
+                cpu_halt();
+            }
+            continue;
+        }
+        rx_ticks = vbl_ticks;
+        retries = STREAM_RETRIES;
+
+        switch (stream_rx.type) {
+        case STREAM_DATA: {
+            uint16_t block = stream_rx.seq;
+            if (block >= base && block < limit && (block - base) < STREAM_WINDOW) {
+                uint32_t mask = ((uint32_t) 1) << (block - base);
+                if (!(received & mask)) {
+                    if (!stream->store(stream->userdata, block, stream_rx.data, stream_rx.len)) {
+                        return stream_cancel(XMODEM_ERROR);
+                    }
+                    received |= mask;
+                    while (received & 1) {
+                        received >>= 1;
+                        base++;
+                    }
+                    if (base == limit && !stream->advance(stream->userdata, base, &limit)) {
+                        return stream_cancel(XMODEM_ERROR);
+                    }
+                }
+            }
+            // duplicates are acknowledged too, in case the last
+            // acknowledgement was lost
+            stream_write_ack(base, limit, received);
+        } break;
+        case STREAM_END:
+            if (base >= stream_rx.seq) {
+                stream_write_frame(STREAM_END, stream_rx.seq, NULL, 0);
+                serial_flush_buffered();
+                return XMODEM_COMPLETE;
+            }
+            stream_write_ack(base, limit, received);
+            break;
+        case STREAM_HELLO:
+            stream_write_hello();
+            stream_write_ack(base, limit, received);
+            break;
+        case STREAM_CANCEL:
+            return XMODEM_CANCEL;
+        }
+    }
+}
@@ -0,0 +1,127 @@
+#pragma once
+/**
+ * Copyright (c) 2023 Adrian Siekierka
+ *
+ * CartFriend is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * CartFriend is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with CartFriend. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// CartFriend - windowed streaming transfers
+//
+// XMODEM waits for an ACK after every block, which leaves the link idle for
+// a round trip each time. The streaming protocol keeps up to STREAM_WINDOW
+// blocks in flight instead; the receiver acknowledges them with a bitmap, so
+// that only the blocks which were actually lost are sent again.
+//
+// It is negotiated on top of XMODEM: a host which supports it answers the
+// cartridge's XMODEM start request ('C' or NAK) with a STREAM_SYNC byte
+// instead, which XMODEM calls report as XMODEM_STREAM. The reference host
+// implementation is tools/cf_stream.py, which also documents the framing.
+//
+// The serial port must have been opened with xmodem_open_buffered().
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wonderful.h>
+
+#define STREAM_SYNC 0xA5
+#define STREAM_BLOCK_SIZE 256
+// at most 32, the width of the acknowledgement bitmap
+#define STREAM_WINDOW 32
+
+typedef struct __attribute__((packed)) {
+	uint8_t type;
+	uint16_t seq;
+	uint16_t len;
+	uint8_t data[STREAM_BLOCK_SIZE + 2]; // payload, followed by the CRC
+} stream_frame_t;
+
+// An interrupted transfer, which the host may continue where it left off.
+typedef struct {
+	uint32_t size; // number of bytes being transferred
+	uint16_t block; // number of blocks received in order; 0 if none
+	uint16_t crc; // CRC-16 of these blocks
+} stream_resume_t;
+
+typedef struct {
+	void *userdata;
+	// total number of bytes, if known in advance; 0 otherwise
+	uint32_t size;
+	// receiving: the first block expected, when resuming (see stream_accept)
+	uint16_t start;
+
+	/**
+	 * Sending: fill data with the given block; return its length, which is
+	 * STREAM_BLOCK_SIZE for all but the last block. Blocks may be requested
+	 * more than once, and out of order.
+	 */
+	uint16_t (*load)(void *userdata, uint16_t block, uint8_t *data);
+
+	/**
+	 * Receiving: store the given block. Blocks may arrive out of order, but
+	 * only once each, and never at or past the current limit (see advance).
+	 * @return false to abort the transfer.
+	 */
+	bool (*store)(void *userdata, uint16_t block, const uint8_t *data, uint16_t len);
+	/**
+	 * Receiving: called at the start, and whenever all blocks up to the
+	 * current limit have been stored. The sender is stopped at that point,
+	 * so slow work, such as erasing flash, can be done here without losing
+	 * any data.
+	 * @param limit Set to the first block which may not be sent yet; 0xFFFF
+	 * for no limit. Setting it to base accepts no further blocks.
+	 * @return false to abort the transfer.
+	 */
+	bool (*advance)(void *userdata, uint16_t base, uint16_t *limit);
+} stream_t;
+
+/**
+ * @brief Collect incoming bytes, without blocking. Besides transfers, this
+ * framing also carries the command server's packets (see remote.h).
+ * @return The next frame with a valid CRC, valid until the next call; or
+ * NULL if none is complete yet.
+ */
+const stream_frame_t *stream_read_frame(void);
+void stream_write_frame(uint8_t type, uint16_t seq, const uint8_t *data, uint16_t len);
+
+/**
+ * @brief Continue a transfer after an XMODEM call returned XMODEM_STREAM, by
+ * reading the rest of the host's greeting and answering it.
+ * @param size The number of bytes the cartridge is about to send, or 0.
+ * @param host_size If not NULL, set to the number of bytes the host is about
+ * to send, or 0 if it did not say.
+ * @param resume If not NULL, a transfer which the host may resume. It is
+ * offered if the host supports resuming and is about to send as many bytes;
+ * the host then either continues from resume->block, or cancels if its data
+ * does not match the CRC. Otherwise, resume->block is set to 0.
+ * @return XMODEM_OK, or an XMODEM error code.
+ */
+uint8_t stream_accept(uint32_t size, uint32_t *host_size, stream_resume_t *resume);
+
+/**
+ * @brief Tell the other side that the transfer has been aborted.
+ * @return result, for convenience.
+ */
+uint8_t stream_cancel(uint8_t result);
+
+/**
+ * @brief Send stream->size bytes, requested block by block with load().
+ * @return XMODEM_OK once the host has confirmed all of them.
+ */
+uint8_t stream_send(const stream_t *stream);
+
+/**
+ * @brief Receive blocks until the sender ends the transfer.
+ * @return XMODEM_COMPLETE once all blocks have been stored.
+ */
+uint8_t stream_recv(const stream_t *stream);
@@ -16,12 +16,11 @@
  */
 
 #include <stdbool.h>
-#include <stdio.h>
 #include <string.h>
 #include <ws.h>
-#include <wsx/planar_unpack.h>
 #include "config.h"
 #include "driver.h"
+#include "format.h"
 #include "input.h"
 #include "lang.h"
 #include "settings.h"
@@ -29,7 +28,6 @@
 #include "../res/font_default.h"
 #include "util.h"
 
-const char __far* const __far* lang_keys;
 #ifdef USE_LOW_BATTERY_WARNING
 extern uint8_t ui_low_battery_flag;
 #endif
@@ -124,24 +122,196 @@ void ui_update_theme(uint8_t current_theme) {
     }
 }
 
+// Tile update queue
+//
+// Rows posted here are rendered into RAM right away, but only copied to the
+// screen by the VBlank interrupt, so long-running operations can update
+// the UI without tearing and without waiting for the right LCD line.
+
+#define UI_QUEUE_ROWS 4
+
+typedef struct {
+    uint16_t *dest; // NULL if free
+    uint16_t tiles[32];
+} ui_queue_row_t;
+
+static ui_queue_row_t ui_queue[UI_QUEUE_ROWS];
+
+void ui_queue_flush(void) {
+    ui_queue_row_t *row = ui_queue;
+    for (uint8_t i = 0; i < UI_QUEUE_ROWS; i++, row++) {
+        if (row->dest != NULL) {
+            _nmemcpy(row->dest, row->tiles, sizeof(row->tiles));
+            row->dest = NULL;
+        }
+    }
+}
+
+static void ui_queue_clear(void) {
+    cpu_irq_disable();
+    for (uint8_t i = 0; i < UI_QUEUE_ROWS; i++) {
+        ui_queue[i].dest = NULL;
+    }
+    cpu_irq_enable();
+}
+
 void ui_reset_alt_screen(void) {
+    ui_queue_clear();
     for (uint16_t i = 0; i < 32*16; i++) {
         SCREEN2[i + 32] = SCR_ENTRY_PALETTE(7);
     }
 }
 
+// Language strings
+
+typedef struct {
+    uint16_t key;
+    uint16_t last_used;
+    char text[LANG_MAX_LENGTH + 1];
+} lang_cache_entry_t;
+
+static const uint16_t __far* lang_offsets;
+static lang_cache_entry_t lang_cache[LANG_CACHE_ENTRIES];
+static uint16_t lang_cache_ticks;
+
+static void lang_set(const uint16_t __far* offsets) {
+    lang_offsets = offsets;
+    for (uint8_t i = 0; i < LANG_CACHE_ENTRIES; i++) {
+        lang_cache[i].key = LK_TOTAL;
+    }
+}
+
+const char __far* lang_get(uint16_t key) {
+    lang_cache_entry_t *entry = lang_cache;
+    lang_cache_ticks++;
+
+    // find the key, or else the least recently used entry
+    for (uint8_t i = 0; i < LANG_CACHE_ENTRIES; i++) {
+        if (lang_cache[i].key == key) {
+            lang_cache[i].last_used = lang_cache_ticks;
+            return lang_cache[i].text;
+        }
+        if ((uint16_t) (lang_cache_ticks - lang_cache[i].last_used) > (uint16_t) (lang_cache_ticks - entry->last_used)) {
+            entry = lang_cache + i;
+        }
+    }
+
+    const uint8_t __far* src = lang_data + lang_offsets[key];
+    char *dst = entry->text;
+    uint8_t c;
+    while ((c = *(src++)) != 0) {
+        if (c >= LANG_TOKEN_FIRST) {
+            const uint8_t __far* token = lang_dict + lang_dict_offsets[c - LANG_TOKEN_FIRST];
+            const uint8_t __far* token_end = lang_dict + lang_dict_offsets[c - LANG_TOKEN_FIRST + 1];
+            while (token < token_end) {
+                *(dst++) = *(token++);
+            }
+        } else {
+            *(dst++) = c;
+        }
+    }
+    *dst = '\0';
+
+    entry->key = key;
+    entry->last_used = lang_cache_ticks;
+    return entry->text;
+}
+
+// Font - installed at 0x2000 in blocks of 32 glyphs. The blocks used by the
+// UI and the current language are installed before the first frame is
+// shown; the others follow, one per VBlank.
+
+#define UI_FONT_BLOCK_SIZE (32 * 8)
+#define UI_FONT_BLOCKS (_font_default_bin_size / UI_FONT_BLOCK_SIZE)
+#define UI_FONT_BLOCKS_ALL ((1 << UI_FONT_BLOCKS) - 1)
+// ASCII, UI icons, the progress bar and the menu divider
+#define UI_FONT_BLOCKS_UI 0x006F
+
+static bool ui_font_installed;
+static uint16_t ui_font_blocks_lang;
+static volatile uint16_t ui_font_blocks_pending;
+
+static inline void ui_font_install_block(uint8_t block) {
+    ui_font_expand(_font_default_bin + block * UI_FONT_BLOCK_SIZE,
+        (uint16_t*) (0x2000 + block * UI_FONT_BLOCK_SIZE * 2), UI_FONT_BLOCK_SIZE);
+}
+
+static void ui_font_install_blocks(uint16_t mask) {
+    for (uint8_t block = 0; block < UI_FONT_BLOCKS; block++) {
+        uint16_t bit = 1 << block;
+        if (mask & bit) {
+            cpu_irq_disable();
+            bool pending = ui_font_blocks_pending & bit;
+            ui_font_blocks_pending &= ~bit;
+            cpu_irq_enable();
+            if (pending) {
+                ui_font_install_block(block);
+            }
+        }
+    }
+}
+
+void ui_font_vblank(void) {
+    uint16_t pending = ui_font_blocks_pending;
+    if (pending) {
+        uint8_t block = 0;
+        while (!(pending & 1)) {
+            pending >>= 1;
+            block++;
+        }
+        ui_font_blocks_pending &= ~(1 << block);
+        ui_font_install_block(block);
+    }
+}
+
 uint8_t ui_set_language(uint8_t id) {
     if (id >= UI_LANGUAGE_MAX) id = UI_LANGUAGE_EN;
     switch (id) {
-    case UI_LANGUAGE_EN: lang_keys = lang_keys_en; break;
-    case UI_LANGUAGE_PL: lang_keys = lang_keys_pl; break;
-    case UI_LANGUAGE_DE: lang_keys = lang_keys_de; break;
+    case UI_LANGUAGE_EN: lang_set(lang_keys_en); ui_font_blocks_lang = LANG_GLYPH_BLOCKS_EN; break;
+    case UI_LANGUAGE_PL: lang_set(lang_keys_pl); ui_font_blocks_lang = LANG_GLYPH_BLOCKS_PL; break;
+    case UI_LANGUAGE_DE: lang_set(lang_keys_de); ui_font_blocks_lang = LANG_GLYPH_BLOCKS_DE; break;
+    }
+    if (ui_font_installed) {
+        ui_font_install_blocks(ui_font_blocks_lang);
     }
     return id;
 }
 
+// Main screen pages
+//
+// On Color, the spare VRAM above 0x4000 holds two more main screen pages.
+// While a tab's menu is idle, its neighbours are pre-rendered into them, so
+// that switching tabs only has to change the screen base register.
+
+#define UI_PAGES 3
+#define UI_PAGE_NONE 0xFF
+
+static uint16_t * const __far ui_page_screens[UI_PAGES] = {
+    (uint16_t*) 0x1800, (uint16_t*) 0x4000, (uint16_t*) 0x4800
+};
+uint16_t *ui_screen1;
+static uint8_t ui_page_active;
+static uint8_t ui_page_tab[UI_PAGES];
+static uint8_t ui_page_scroll_y[UI_PAGES];
+static uint8_t ui_page_skip_tabs; // tabs which could not be pre-rendered
+static bool ui_page_prerendering;
+// the active page was pre-rendered, and nothing has changed since
+static bool ui_page_ready;
+
+static void ui_screen_update_base(void) {
+    outportb(IO_SCR_BASE, (((uint16_t) SCREEN1) >> 11) | ((((uint16_t) SCREEN2) >> 11) << 4));
+}
+
+static void ui_screen_update_scroll(void) {
+    if (!ui_page_prerendering) {
+        outportb(IO_SCR1_SCRL_X, settings_local.flags1 & SETT_FLAGS1_WIDE_SCREEN ? 0 : 252);
+        outportb(IO_SCR1_SCRL_Y, (scroll_y - 1) << 3);
+    }
+}
+
 void ui_init(void) {
-    lang_keys = lang_keys_en;
+    lang_set(lang_keys_en);
+    ui_font_blocks_lang = LANG_GLYPH_BLOCKS_EN;
 #ifdef USE_LOW_BATTERY_WARNING
     ui_low_battery_flag = 0;
 #endif
@@ -160,9 +330,13 @@ void ui_init(void) {
     ui_dialog_open = false;
     ui_update_theme(0);
 
-    // install font @ 0x2000
-    wsx_planar_unpack((uint16_t*) 0x2000, _font_default_bin_size, _font_default_bin, WSX_PLANAR_UNPACK_1BPP_TO_2BPP_ZERO(1));
+    // the font is installed on first ui_show(), so that booting straight
+    // into a game does not have to wait for it
+    ui_font_installed = false;
+    ui_font_blocks_pending = 0;
 
+    ui_page_active = 0;
+    SCREEN1 = ui_page_screens[0];
     ui_reset_main_screen();
     ui_reset_alt_screen();
 
@@ -171,12 +345,17 @@ void ui_init(void) {
         SCREEN2[i + (17 << 5)] = SCR_ENTRY_PALETTE(2);
     }
 
-    outportb(IO_SCR_BASE, SCR1_BASE((uint16_t) SCREEN1) | SCR2_BASE((uint16_t) SCREEN2));
-    //ui_puts(true, 28 - strlen(lang_keys[LK_NAME]), 17, 2, lang_keys[LK_NAME]);
+    ui_screen_update_base();
+    //ui_puts(true, 28 - strlen(lang_get(LK_NAME)), 17, 2, lang_get(LK_NAME));
     ui_fg_putc(26, 17, UI_GLYPH_PASSAGE, 2);
 }
 
 void ui_show(void) {
+    if (!ui_font_installed) {
+        ui_font_installed = true;
+        ui_font_blocks_pending = UI_FONT_BLOCKS_ALL;
+        ui_font_install_blocks(UI_FONT_BLOCKS_UI | ui_font_blocks_lang);
+    }
     outportw(IO_DISPLAY_CTRL, DISPLAY_SCR1_ENABLE | DISPLAY_SCR2_ENABLE);
 }
 
@@ -185,15 +364,104 @@ void ui_hide(void) {
 }
 
 void ui_reset_main_screen(void) {
+    ui_queue_clear();
+    ui_page_invalidate();
     scroll_y = 0;
-    outportb(IO_SCR1_SCRL_X, settings_local.flags1 & SETT_FLAGS1_WIDE_SCREEN ? 0 : 252);
-    outportb(IO_SCR1_SCRL_Y, 248);
+    ui_screen_update_scroll();
     _nmemset(SCREEN1, 0, 0x800);
 }
 
 void ui_scroll(int8_t offset) {
     scroll_y = (scroll_y + offset) & 31;
-    outportb(IO_SCR1_SCRL_Y, (scroll_y - 1) << 3);
+    ui_screen_update_scroll();
+}
+
+void ui_page_invalidate(void) {
+    if (!ui_page_prerendering) {
+        for (uint8_t i = 0; i < UI_PAGES; i++) {
+            ui_page_tab[i] = UI_PAGE_NONE;
+        }
+        ui_page_skip_tabs = 0;
+        ui_page_ready = false;
+    }
+}
+
+bool ui_page_switch(uint8_t tab) {
+    for (uint8_t i = 0; i < UI_PAGES; i++) {
+        if (i != ui_page_active && ui_page_tab[i] == tab) {
+            ui_queue_clear();
+            ui_page_active = i;
+            SCREEN1 = ui_page_screens[i];
+            scroll_y = ui_page_scroll_y[i];
+            ui_screen_update_scroll();
+            ui_screen_update_base();
+            // the neighbours have changed
+            ui_page_invalidate();
+            ui_page_ready = true;
+            return true;
+        }
+    }
+    ui_reset_main_screen();
+    return false;
+}
+
+static bool ui_page_prerender(uint8_t page, uint8_t tab) {
+    uint16_t *prev_screen = SCREEN1;
+    uint8_t prev_scroll_y = scroll_y;
+    bool result = false;
+
+    ui_page_prerendering = true;
+    SCREEN1 = ui_page_screens[page];
+    scroll_y = 0;
+    _nmemset(SCREEN1, 0, 0x800);
+    switch (tab) {
+#ifdef USE_SLOT_SYSTEM
+    case UI_TAB_BROWSE: result = ui_browse_prerender(); break;
+#endif
+    case UI_TAB_TOOLS: result = ui_tools_prerender(); break;
+    case UI_TAB_SETTINGS: result = ui_settings_prerender(); break;
+    case UI_TAB_ABOUT: result = ui_about_prerender(); break;
+    }
+    ui_page_scroll_y[page] = scroll_y;
+    SCREEN1 = prev_screen;
+    scroll_y = prev_scroll_y;
+    ui_page_prerendering = false;
+
+    return result;
+}
+
+void ui_page_idle(void) {
+    if (!ws_system_color_active()) {
+        return;
+    }
+
+    // pre-render one missing neighbour per call
+    for (int8_t delta = -1; delta <= 1; delta += 2) {
+        uint8_t tab = ui_current_tab + delta;
+        if (tab >= UI_TAB_TOTAL || (ui_page_skip_tabs & (1 << tab))) {
+            continue;
+        }
+
+        uint8_t free_page = UI_PAGE_NONE;
+        for (uint8_t i = 0; i < UI_PAGES; i++) {
+            if (i == ui_page_active) {
+                continue;
+            } else if (ui_page_tab[i] == tab) {
+                free_page = UI_PAGE_NONE;
+                break;
+            } else if (ui_page_tab[i] == UI_PAGE_NONE && free_page == UI_PAGE_NONE) {
+                free_page = i;
+            }
+        }
+        if (free_page != UI_PAGE_NONE) {
+            if (ui_page_prerender(free_page, tab)) {
+                ui_page_tab[free_page] = tab;
+            } else {
+                ui_page_skip_tabs |= 1 << tab;
+            }
+            return;
+        }
+    }
 }
 
 inline void ui_bg_putc(uint8_t x, uint8_t y, uint16_t chr, uint8_t color) {
@@ -207,25 +475,17 @@ inline void ui_fg_putc(uint8_t x, uint8_t y, uint16_t chr, uint8_t color) {
 }
 
 void ui_fill_line(uint8_t y, uint8_t color) {
-    uint16_t prefix = SCR_ENTRY_PALETTE(color);
-    uint16_t *screen = SCREEN1 + (y << 5);
-    for (uint8_t i = 0; i < 32; i++) {
-        *(screen++) = prefix;
+    ui_blit_fill(ui_screen_at(SCREEN1, 0, y), SCR_ENTRY_PALETTE(color), 32, 1);
+}
+
+static void ui_puts_screen(uint16_t *screen, uint8_t x, uint8_t y, uint8_t color, const char __far* buf) {
+    if (x < 28) {
+        ui_blit_puts(ui_screen_at(screen, x, y), SCR_ENTRY_PALETTE(color), 28 - x, buf);
     }
 }
 
 void ui_puts(bool alt_screen, uint8_t x, uint8_t y, uint8_t color, const char __far* buf) {
-    uint16_t prefix = SCR_ENTRY_PALETTE(color);
-    uint16_t *screen = alt_screen ? SCREEN2 : SCREEN1;
-    while (*buf != '\0') {
-        if (*buf == '\x05') {
-            if (color == 0) prefix = SCR_ENTRY_PALETTE(UI_PAL_LIGHT);
-            buf++;
-            continue;
-        }
-        ws_screen_put_tile(screen, prefix | ((uint8_t) *(buf++)), x++, y);
-        if (x == 28) return;
-    }
+    ui_puts_screen(alt_screen ? SCREEN2 : SCREEN1, x, y, color, buf);
 }
 
 void ui_puts_centered(bool alt_screen, uint8_t y, uint8_t color, const char __far* buf) {
@@ -237,7 +497,7 @@ void ui_bg_printf(uint8_t x, uint8_t y, uint8_t color, const char __far* format,
     char buf[33];
     va_list val;
     va_start(val, format);
-    vsnprintf(buf, sizeof(buf), format, val);
+    format_vsnprintf(buf, sizeof(buf), format, val);
     va_end(val);
     ui_puts(false, x, y, color, buf);
 }
@@ -246,7 +506,7 @@ void ui_bg_printf_centered(uint8_t y, uint8_t color, const char __far* format, .
     char buf[33];
     va_list val;
     va_start(val, format);
-    vsnprintf(buf, sizeof(buf), format, val);
+    format_vsnprintf(buf, sizeof(buf), format, val);
     va_end(val);
     uint8_t x = (MAIN_SCREEN_WIDTH - strlen(buf)) >> 1;
     ui_puts(false, x, y, color, buf);
@@ -256,11 +516,54 @@ void ui_bg_printf_right(uint8_t x, uint8_t y, uint8_t color, const char __far* f
     char buf[33];
     va_list val;
     va_start(val, format);
-    int len = vsnprintf(buf, sizeof(buf), format, val);
+    int len = format_vsnprintf(buf, sizeof(buf), format, val);
     va_end(val);
     ui_puts(false, x + 1 - len, y, color, buf);
 }
 
+// Tile update queue (posting)
+
+static void ui_queue_row(uint16_t *dest, const uint16_t *tiles) {
+    while (true) {
+        cpu_irq_disable();
+        ui_queue_row_t *target = NULL;
+        for (uint8_t i = 0; i < UI_QUEUE_ROWS; i++) {
+            // a newer update of the same row replaces the pending one
+            if (ui_queue[i].dest == dest) {
+                target = ui_queue + i;
+                break;
+            } else if (ui_queue[i].dest == NULL && target == NULL) {
+                target = ui_queue + i;
+            }
+        }
+        if (target != NULL) {
+            target->dest = dest;
+            _nmemcpy(target->tiles, tiles, sizeof(target->tiles));
+            cpu_irq_enable();
+            return;
+        }
+        cpu_irq_enable();
+        // queue full, let the next VBlank drain it
+        wait_for_vblank();
+    }
+}
+
+void ui_queue_puts_centered(uint8_t y, uint8_t color, const char __far* buf) {
+    uint16_t tiles[32];
+    ui_blit_fill(tiles, SCR_ENTRY_PALETTE(color), 32, 1);
+    ui_puts_screen(tiles, (MAIN_SCREEN_WIDTH - strlen(buf)) >> 1, 0, color, buf);
+    ui_queue_row(ui_screen_at(SCREEN1, 0, y), tiles);
+}
+
+void ui_queue_printf_centered(uint8_t y, uint8_t color, const char __far* format, ...) {
+    char buf[33];
+    va_list val;
+    va_start(val, format);
+    format_vsnprintf(buf, sizeof(buf), format, val);
+    va_end(val);
+    ui_queue_puts_centered(y, color, buf);
+}
+
 // Tabs
 
 static uint16_t __far ui_tabs_to_lks[] = {
@@ -277,7 +580,7 @@ uint8_t ui_current_tab;
 void ui_set_current_tab(uint8_t tab) {
     uint8_t x = 0;
     bool active = true;
-    const char __far* text = lang_keys[ui_tabs_to_lks[tab]];
+    const char __far* text = lang_get(ui_tabs_to_lks[tab]);
     bool finished = false;
 
     ui_current_tab = tab;
@@ -299,7 +602,7 @@ void ui_set_current_tab(uint8_t tab) {
             if (lk == LK_TOTAL) {
                 finished = true;
             } else {
-                text = lang_keys[lk];
+                text = lang_get(lk);
             }
         } else {
             finished = true;
@@ -370,33 +673,47 @@ bool ui_poll_events(void) {
 
 // Work indicator
 
-extern uint16_t vbl_ticks;
-uint8_t ui_work_indicator;
-uint16_t ui_work_indicator_vbl_ticks;
+extern volatile uint16_t vbl_ticks;
+static uint8_t ui_work_indicator;
+volatile bool ui_work_indicator_pending;
+static ui_pbar_state_t * volatile ui_pbar_active;
 static const uint8_t __far ui_work_table[] = {
     'q', 'd', 'b', 'p'
 };
 
-void ui_step_work_indicator(void) {
-    uint16_t ticks = vbl_ticks >> 2;
-    if (ui_work_indicator_vbl_ticks == 0xFF || (ui_work_indicator_vbl_ticks != ticks)) {
+static void ui_pbar_draw(ui_pbar_state_t *state);
+
+void ui_progress_vblank(void) {
+    if (ui_pbar_active != NULL) {
+        ui_pbar_draw(ui_pbar_active);
+    }
+    if (ui_work_indicator_pending && !(vbl_ticks & 3)) {
+        ui_work_indicator_pending = false;
         ui_fg_putc(UI_WORK_INDICATOR_X, 17, ui_work_table[ui_work_indicator], 2);
         ui_work_indicator = (ui_work_indicator + 1) & 3;
-        ui_work_indicator_vbl_ticks = ticks;
     }
 }
 
 void ui_clear_work_indicator(void) {
+    ui_work_indicator_pending = false;
     ui_work_indicator = 0;
-    ui_work_indicator_vbl_ticks = 0xFF;
     ui_fg_putc(UI_WORK_INDICATOR_X, 17, ' ', 2);
 }
 
 // Menu system
 
-static void ui_menu_draw_line(ui_menu_state_t *menu, uint8_t pos, uint8_t color) {
-    if (menu->list[pos] == MENU_ENTRY_DIVIDER) {
-        ws_screen_fill_tiles(SCREEN1, 196, 0, pos, 32, 1);
+static inline uint8_t ui_menu_entry_at(ui_menu_state_t *menu, uint16_t pos) {
+    if (menu->list == NULL) {
+        return pos < menu->height ? MENU_ENTRY_ROW : MENU_ENTRY_END;
+    }
+    return menu->list[pos];
+}
+
+static void ui_menu_draw_line(ui_menu_state_t *menu, uint16_t pos, uint8_t color) {
+    uint8_t entry = ui_menu_entry_at(menu, pos);
+    uint8_t y = pos & 31;
+    if (entry == MENU_ENTRY_DIVIDER) {
+        ui_blit_fill(ui_screen_at(SCREEN1, 0, y), 196, 32, 1);
         return;
     }
 
@@ -404,12 +721,13 @@ static void ui_menu_draw_line(ui_menu_state_t *menu, uint8_t pos, uint8_t color)
     char buf_right[31];
     buf[0] = 0; buf_right[0] = 0;
 
-    menu->build_line_func(menu->list[pos], menu->build_line_data, buf, 30, buf_right, 30);
+    // virtual menus build their rows from the row index alone
+    menu->build_line_func(entry == MENU_ENTRY_ROW ? pos : entry, menu->build_line_data, buf, 30, buf_right, 30);
     if (buf[0] != 0) {
-        ui_puts(false, 0, pos, color, buf);
+        ui_puts(false, 0, y, color, buf);
     }
     if (buf_right[0] != 0) {
-        ui_puts(false, MAIN_SCREEN_WIDTH - strlen(buf_right), pos, color, buf_right);
+        ui_puts(false, MAIN_SCREEN_WIDTH - strlen(buf_right), y, color, buf_right);
     }
 }
 
@@ -417,6 +735,7 @@ static void ui_menu_redraw(ui_menu_state_t *menu) {
     if (menu->height > 0) {
         for (uint8_t i = 0; i < 16; i++) {
             if (i >= menu->height) break;
+            ui_fill_line(menu->y + i, 0);
             ui_menu_draw_line(menu, menu->y + i, 0);
         }
         ui_fill_line(menu->pos, 1);
@@ -424,21 +743,29 @@ static void ui_menu_redraw(ui_menu_state_t *menu) {
     }
 }
 
-static uint8_t ui_menu_list_move_pos(uint8_t *list, int8_t delta, uint8_t pos, uint8_t height) {
-    int last_pos;
-    int new_pos = pos;
+static uint16_t ui_menu_list_move_pos(uint8_t *list, int8_t delta, uint16_t pos, uint16_t height) {
+    uint16_t last_pos;
+    uint16_t new_pos = pos;
     do {
         last_pos = new_pos;
-        new_pos = new_pos + delta;
-        if (new_pos < 0) new_pos = 0;
-        else if (new_pos >= height) new_pos = height - 1;
-    } while (last_pos != new_pos && (list[new_pos] == MENU_ENTRY_DIVIDER));
+        if (delta < 0) {
+            if (new_pos > 0) new_pos--;
+        } else {
+            if (new_pos + 1 < height) new_pos++;
+        }
+    } while (last_pos != new_pos && list != NULL && (list[new_pos] == MENU_ENTRY_DIVIDER));
 
     return new_pos;
 }
 
+static uint16_t ui_menu_scroll_target(ui_menu_state_t *menu) {
+    uint16_t new_y = menu->pos < 8 ? 0 : menu->pos - 8;
+    if (new_y >= menu->y_max) new_y = menu->y_max;
+    return new_y;
+}
+
 static void ui_menu_move(ui_menu_state_t *menu, int8_t delta) {
-    uint8_t new_pos = ui_menu_list_move_pos(menu->list, delta, menu->pos, menu->height);
+    uint16_t new_pos = ui_menu_list_move_pos(menu->list, delta, menu->pos, menu->height);
     if (new_pos == menu->pos) return;
 
     // draw lines
@@ -449,30 +776,65 @@ static void ui_menu_move(ui_menu_state_t *menu, int8_t delta) {
     ui_menu_draw_line(menu, menu->pos, 1);
 
     // adjust scroll
-    int new_y = menu->pos - 8;
-    if (new_y < 0) new_y = 0;
-    else if (new_y >= menu->y_max) new_y = menu->y_max;
-    int scroll_delta = new_y - menu->y;
+    uint16_t new_y = ui_menu_scroll_target(menu);
+    int16_t scroll_delta = new_y - menu->y;
     if (scroll_delta != 0) {
         ui_scroll(scroll_delta);
         menu->y = new_y;
 
-        // TODO: optimize
-        ui_menu_redraw(menu);
+        if (scroll_delta > -16 && scroll_delta < 16) {
+            // the rest of the view is already in the tilemap; only draw
+            // the rows which have just scrolled into it
+            uint16_t row = scroll_delta > 0 ? (menu->y + 16 - scroll_delta) : menu->y;
+            uint8_t count = scroll_delta > 0 ? scroll_delta : -scroll_delta;
+            for (uint8_t i = 0; i < count; i++, row++) {
+                uint8_t color = (row == menu->pos) ? 1 : 0;
+                ui_fill_line(row, color);
+                ui_menu_draw_line(menu, row, color);
+            }
+        } else {
+            ui_menu_redraw(menu);
+        }
     }
 }
 
 void ui_menu_init(ui_menu_state_t *menu) {
-    menu->height = u8_arraylist_len(menu->list);
+    if (menu->list != NULL) {
+        menu->height = u8_arraylist_len(menu->list);
+    }
     menu->pos = 0;
     menu->y = 0;
-    menu->y_max = menu->height - 16;
-    if (menu->y_max > menu->height) menu->y_max = 0;
+    menu->y_max = menu->height > 16 ? menu->height - 16 : 0;
+}
+
+void ui_menu_set_pos(ui_menu_state_t *menu, uint16_t pos) {
+    if (menu->height == 0) return;
+    if (pos >= menu->height) pos = menu->height - 1;
+    menu->pos = pos;
+    if (ui_menu_entry_at(menu, pos) == MENU_ENTRY_DIVIDER) {
+        menu->pos = ui_menu_list_move_pos(menu->list, 1, pos, menu->height);
+        if (ui_menu_entry_at(menu, menu->pos) == MENU_ENTRY_DIVIDER) {
+            menu->pos = ui_menu_list_move_pos(menu->list, -1, pos, menu->height);
+        }
+    }
+    menu->y = ui_menu_scroll_target(menu);
+}
+
+void ui_menu_draw(ui_menu_state_t *menu) {
+    // the menu may be re-entered with its previous scroll position kept
+    ui_scroll((menu->y - scroll_y) & 31);
+    ui_menu_redraw(menu);
 }
 
 uint16_t ui_menu_select(ui_menu_state_t *menu) {
+    uint8_t tab = ui_current_tab;
     ui_clear_work_indicator();
-    ui_menu_redraw(menu);
+    if (ui_page_ready) {
+        // the tab's menu is on screen already, as it was pre-rendered
+        ui_page_ready = false;
+    } else {
+        ui_menu_draw(menu);
+    }
 
     uint16_t result = MENU_ENTRY_END;
     while (ui_poll_events()) {
@@ -483,7 +845,13 @@ uint16_t ui_menu_select(ui_menu_state_t *menu) {
             ui_menu_move(menu, 1);
         }
         wait_for_vblank();
-        uint8_t curr_entry = menu->list[menu->pos];
+        if (input_held == 0) {
+            if (menu->idle_func != NULL && menu->idle_func(menu->build_line_data)) {
+                ui_menu_redraw(menu);
+            }
+            ui_page_idle();
+        }
+        uint8_t curr_entry = ui_menu_entry_at(menu, menu->pos);
         if (menu->flags & MENU_SEND_LEFT_RIGHT) {
             if (input_pressed & KEY_LEFT) {
                 result = curr_entry | MENU_ACTION_LEFT;
@@ -511,6 +879,10 @@ uint16_t ui_menu_select(ui_menu_state_t *menu) {
         }
     }
 
+    if (ui_current_tab == tab) {
+        // whatever was selected may change what the other tabs show
+        ui_page_invalidate();
+    }
     return result;
 }
 
@@ -526,7 +898,7 @@ static uint8_t ui_popup_menu_strlen(ui_popup_menu_state_t *menu, uint8_t i) {
 
 static void ui_popup_menu_draw_line(ui_popup_menu_state_t *menu, uint8_t pos, uint8_t color) {
     if (menu->list[pos] == MENU_ENTRY_DIVIDER) {
-        ws_screen_fill_tiles(SCREEN2, 196 | SCR_ENTRY_PALETTE(8), menu->x, menu->y + pos, menu->width, 1);
+        ui_blit_fill(ui_screen_at(SCREEN2, menu->x, menu->y + pos), 196 | SCR_ENTRY_PALETTE(8), menu->width, 1);
         return;
     }
 
@@ -534,7 +906,7 @@ static void ui_popup_menu_draw_line(ui_popup_menu_state_t *menu, uint8_t pos, ui
     buf[0] = 0;
 
     menu->build_line_func(menu->list[pos], menu->build_line_data, buf, 30);
-    ws_screen_fill_tiles(SCREEN2, SCR_ENTRY_PALETTE(color), menu->x, menu->y + pos, menu->width, 1);    
+    ui_blit_fill(ui_screen_at(SCREEN2, menu->x, menu->y + pos), SCR_ENTRY_PALETTE(color), menu->width, 1);
     if (buf[0] != 0) {
         ui_puts(true, menu->x + 1, menu->y + pos, color, buf);
     }
@@ -629,19 +1001,37 @@ void ui_pbar_init(ui_pbar_state_t *state) {
     }
 }
 
-void ui_pbar_draw(ui_pbar_state_t *state) {
+static void ui_pbar_draw(ui_pbar_state_t *state) {
+    if (state->step_max == 0) {
+        return;
+    }
     uint16_t step_count = state->width * 8;
     uint16_t step_current = (((uint32_t) state->step) * step_count) / state->step_max;
-    if (state->step_last != step_current) {
-        uint8_t i = 0;
-        uint8_t x = state->x;
-        for (i = 8; i <= step_current; i += 8) {
+    if (step_current > step_count) {
+        step_current = step_count;
+    }
+    if (state->step_last < step_current) {
+        // only the cells from the previously drawn end onwards change
+        uint8_t x = state->x + (state->step_last >> 3);
+        uint8_t i;
+        for (i = (state->step_last & ~7) + 8; i <= step_current; i += 8) {
             ui_bg_putc(x++, state->y, 219, UI_PAL_PBAR);
         }
-        step_current &= 7;
-        if (step_current > 0) {
-            ui_bg_putc(x, state->y, step_current + UI_GLYPH_HORIZONTAL_PBAR, UI_PAL_PBAR);
+        if (step_current & 7) {
+            ui_bg_putc(x, state->y, (step_current & 7) + UI_GLYPH_HORIZONTAL_PBAR, UI_PAL_PBAR);
         }
+        state->step_last = step_current;
+    }
+}
+
+void ui_pbar_show(ui_pbar_state_t *state) {
+    ui_pbar_active = state;
+}
+
+void ui_pbar_hide(ui_pbar_state_t *state) {
+    if (ui_pbar_active == state) {
+        ui_pbar_active = NULL;
+        ui_pbar_draw(state);
     }
 }
 
@@ -703,20 +1093,20 @@ uint8_t ui_dialog_run(uint16_t flags, uint8_t initial_option, uint16_t lk_questi
     ui_update_theme(settings_local.color_theme);
 
     uint8_t max_line_width = 0;
-    uint8_t line_count = sep_count_lines(lang_keys[lk_question], &max_line_width);
-    uint8_t option_count = sep_count_lines(lang_keys[lk_options], &max_line_width);
+    uint8_t line_count = sep_count_lines(lang_get(lk_question), &max_line_width);
+    uint8_t option_count = sep_count_lines(lang_get(lk_options), &max_line_width);
 
     uint8_t width = ((max_line_width + 2) + 1) & 0xFE;
     uint8_t height = ((line_count + option_count + 3) + 1) & 0xFE;
     uint8_t x = 14 - ((width + 1) >> 1);
     uint8_t y = 9 - ((height + 1) >> 1);
-    ws_screen_fill_tiles(SCREEN2, SCR_ENTRY_PALETTE(UI_PAL_DIALOG), x, y, width, height);
+    ui_blit_fill(ui_screen_at(SCREEN2, x, y), SCR_ENTRY_PALETTE(UI_PAL_DIALOG), width, height);
     uint8_t selected_option = initial_option;
 
     // draw text
-    sep_draw(lang_keys[lk_question], x + 1, y + 1, 0xFF, true);
+    sep_draw(lang_get(lk_question), x + 1, y + 1, 0xFF, true);
     while (true) {
-        sep_draw(lang_keys[lk_options], x + 1, y + height - option_count - 1, selected_option, false);
+        sep_draw(lang_get(lk_options), x + 1, y + height - option_count - 1, selected_option, false);
 
         wait_for_vblank();
         input_update();
@@ -34,10 +34,32 @@
 #define UI_PAL_PBAR    10
 #define UI_PAL_LIGHT   11
 
-#define SCREEN1 ((uint16_t*) 0x1800)
+// the main screen is one of several pages, see ui_page_switch()
+#define SCREEN1 ui_screen1
 #define SCREEN2 ((uint16_t*) 0x3800)
 
-extern const char __far* const __far* lang_keys;
+extern uint16_t *ui_screen1;
+
+static inline uint16_t *ui_screen_at(uint16_t *screen, uint8_t x, uint8_t y) {
+    return screen + ((y & 31) << 5) + x;
+}
+
+// ui_asm.s - tilemap blitters
+// Write a string to a screen row, ORing each character with the given prefix.
+// Stops at the terminator or after max_len tiles; handles the \x05 marker.
+void ui_blit_puts(uint16_t *dest, uint16_t prefix, uint8_t max_len, const char __far* buf);
+// Fill a width x height rectangle of a screen with a tile.
+void ui_blit_fill(uint16_t *dest, uint16_t tile, uint8_t width, uint8_t height);
+// Expand 1bpp font data to 2bpp tiles.
+void ui_font_expand(const uint8_t __far* src, uint16_t *dest, uint16_t len);
+
+/**
+ * @brief Look up a language string.
+ * Strings are decompressed into a small cache; only the results of the last
+ * LANG_CACHE_ENTRIES distinct lookups are guaranteed to remain valid.
+ */
+const char __far* lang_get(uint16_t key);
+#define LANG_CACHE_ENTRIES 3
 extern uint8_t ui_low_battery_flag;
 
 void ui_init(void);
@@ -46,6 +68,14 @@ void ui_hide(void);
 void ui_reset_main_screen(void);
 void ui_reset_alt_screen(void);
 void ui_scroll(int8_t offset);
+// Show the page pre-rendered for the given tab, or else clear the main screen.
+// Returns true in the former case; the next ui_menu_select() then leaves the
+// page as it is, unless ui_page_invalidate() is called first.
+bool ui_page_switch(uint8_t tab);
+// Pre-render a neighbouring tab into a spare page, if there is one (Color only).
+void ui_page_idle(void);
+// Drop all pre-rendered pages; they may no longer match the current state.
+void ui_page_invalidate(void);
 void ui_fill_line(uint8_t y, uint8_t color);
 void ui_bg_putc(uint8_t x, uint8_t y, uint16_t chr, uint8_t color);
 void ui_fg_putc(uint8_t x, uint8_t y, uint16_t chr, uint8_t color);
@@ -55,6 +85,11 @@ __attribute__((format(printf, 4, 5))) void ui_bg_printf(uint8_t x, uint8_t y, ui
 __attribute__((format(printf, 3, 4))) void ui_bg_printf_centered(uint8_t y, uint8_t color, const char __far* format, ...);
 __attribute__((format(printf, 4, 5))) void ui_bg_printf_right(uint8_t x, uint8_t y, uint8_t color, const char __far* format, ...);
 
+// Tile update queue - replaces a whole main screen row during the next VBlank
+void ui_queue_flush(void); // called by the VBlank interrupt
+void ui_queue_puts_centered(uint8_t y, uint8_t color, const char __far* buf);
+__attribute__((format(printf, 3, 4))) void ui_queue_printf_centered(uint8_t y, uint8_t color, const char __far* format, ...);
+
 #define UI_THEME_COUNT 3
 void ui_update_theme(uint8_t current_theme);
 uint8_t ui_set_language(uint8_t id);
@@ -90,29 +125,46 @@ typedef enum {
     UI_TAB_TOTAL
 } ui_tab_id_t;
 
-// Work indicator
+// Work indicator and progress bars - drawn by the VBlank interrupt
+
+extern volatile bool ui_work_indicator_pending;
 
-void ui_step_work_indicator(void);
+void ui_progress_vblank(void); // called by the VBlank interrupt
+void ui_font_vblank(void); // called by the VBlank interrupt
+
+// Signal that work is being done; the indicator advances on the next VBlank.
+static inline void ui_step_work_indicator(void) {
+    ui_work_indicator_pending = true;
+}
 void ui_clear_work_indicator(void);
 
 // Menu system
 
+#define MENU_ENTRY_ROW 253
 #define MENU_ENTRY_DIVIDER 254
 #define MENU_ENTRY_END 255
 
-typedef void (*ui_menu_build_line_func)(uint8_t entry_id, void *userdata, char *buf, int buf_len, char *buf_right, int buf_right_len);
+// entry_id is the list entry, or the row index for virtual menus
+typedef void (*ui_menu_build_line_func)(uint16_t entry_id, void *userdata, char *buf, int buf_len, char *buf_right, int buf_right_len);
+// called once per frame while no keys are held; return true to redraw the menu
+typedef bool (*ui_menu_idle_func)(void *userdata);
 
+// A menu either shows a MENU_ENTRY_END-terminated list of entry IDs, or - if
+// list is NULL - a virtual list of height rows, each built on demand. In the
+// latter case, ui_menu_select() returns MENU_ENTRY_ROW for any selection and
+// the chosen row can be read from pos.
 typedef struct {
     uint8_t *list;
     ui_menu_build_line_func build_line_func;
     void *build_line_data;
+    ui_menu_idle_func idle_func;
     uint16_t flags;
+    uint16_t height; // set by the caller for virtual menus
 
     // auto-generated
-    uint8_t height;
-    uint8_t pos;
-    uint8_t y;
-    uint8_t y_max;
+    uint16_t pos;
+    uint16_t y;
+    uint16_t y_max;
 } ui_menu_state_t;
 
 #define MENU_SEND_LEFT_RIGHT 0x0001
@@ -124,6 +176,10 @@ typedef struct {
 #define MENU_ACTION_B     0x0400
 
 void ui_menu_init(ui_menu_state_t *menu);
+// moves the cursor to pos (or the nearest selectable entry) without drawing
+void ui_menu_set_pos(ui_menu_state_t *menu, uint16_t pos);
+// draws the menu without handling input; expects a cleared main screen
+void ui_menu_draw(ui_menu_state_t *menu);
 uint16_t ui_menu_select(ui_menu_state_t *menu);
 
 // Popup menu system
@@ -146,12 +202,16 @@ uint16_t ui_popup_menu_run(ui_popup_menu_state_t *menu);
 // Progress bars
 
 typedef struct {
-    uint16_t step, step_max, step_last;
+    volatile uint16_t step;
+    uint16_t step_max, step_last;
     uint8_t x, y, width;
 } ui_pbar_state_t;
 
 void ui_pbar_init(ui_pbar_state_t *state);
-void ui_pbar_draw(ui_pbar_state_t *state);
+// While shown, the bar is redrawn from state->step by the VBlank interrupt;
+// it must be hidden again before the state goes out of scope.
+void ui_pbar_show(ui_pbar_state_t *state);
+void ui_pbar_hide(ui_pbar_state_t *state);
 
 // Dialogs
 
@@ -159,11 +219,23 @@ void ui_pbar_draw(ui_pbar_state_t *state);
 #define UI_OSK_LAYOUT_IEEP 0x0001
 
 uint8_t ui_dialog_run(uint16_t flags, uint8_t initial_option, uint16_t lk_question, uint16_t lk_options);
-bool ui_osk_run(uint16_t flags, char *buf, uint8_t buf_width); // ui_osk.c
+// called whenever the text in the keyboard's buffer changes
+typedef void (*ui_osk_change_func)(const char *buf, void *userdata);
+bool ui_osk_run(uint16_t flags, char *buf, uint8_t buf_width, ui_osk_change_func change_func, void *userdata); // ui_osk.c
 
 // Tab implementations
+// The *_prerender functions draw the initial view of a tab into the main
+// screen; they return false if this is not possible without user-visible work.
 
 void ui_about(void); // ui_about.c
+bool ui_about_prerender(void); // ui_about.c
 void ui_browse(void); // ui_browse.c
+bool ui_browse_prerender(void); // ui_browse.c
+// launches the last launched software, unless user input is required; returns if it can't
+void ui_browse_quick_resume(void); // ui_browse.c
+// launches a catalog entry, with the save block already switched to; rom_header is its first 16 bytes
+void ui_browse_launch(uint8_t id, const uint8_t *rom_header); // ui_browse.c
 void ui_settings(void); // ui_settings.c
+bool ui_settings_prerender(void); // ui_settings.c
 void ui_tools(void); // ui_tools.c
+bool ui_tools_prerender(void); // ui_tools.c
@@ -40,16 +40,22 @@ static inline int16_t cos(int16_t v) {
     return sin(v + 128);
 }
 
-void ui_about(void) {
-    ui_puts_centered(false, 2, 0, lang_keys[LK_NAME]);
-    // ui_puts_centered(false, 3, lang_keys[LK_RELEASE_DATE], 0);
-    /* ui_bg_printf_centered(3, 0, lang_keys[LK_UI_LOADED_FROM],
+bool ui_about_prerender(void) {
+    ui_puts_centered(false, 2, 0, lang_get(LK_NAME));
+    // ui_puts_centered(false, 3, lang_get(LK_RELEASE_DATE), 0);
+    /* ui_bg_printf_centered(3, 0, lang_get(LK_UI_LOADED_FROM),
         (int) fm_initial_slot[0],
         (int) fm_initial_slot[1],
         (int) fm_initial_slot[2],
         (int) fm_initial_slot[3]); */
-    ui_puts_centered(false, 12, 0, lang_keys[LK_UI_ABOUT_URL_LINE1]);
-    ui_puts_centered(false, 13, 0, lang_keys[LK_UI_ABOUT_URL_LINE2]);
+    ui_puts_centered(false, 12, 0, lang_get(LK_UI_ABOUT_URL_LINE1));
+    ui_puts_centered(false, 13, 0, lang_get(LK_UI_ABOUT_URL_LINE2));
+
+    return true;
+}
+
+void ui_about(void) {
+    ui_about_prerender();
 
     outportb(IO_SPR_BASE, SPR_BASE(SPRITE_TABLE));
     outportb(IO_SPR_FIRST, 128 >> 2);
@@ -68,6 +74,9 @@ void ui_about(void) {
 
     while (ui_poll_events()) {
         wait_for_vblank();
+        if (input_held == 0) {
+            ui_page_idle();
+        }
 
         if (input_held & KEY_UP) {
             rotY -= 9;
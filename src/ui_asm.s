@@ -0,0 +1,159 @@
+/**
+ * Copyright (c) 2023 Adrian Siekierka
+ *
+ * CartFriend is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * CartFriend is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with CartFriend. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <wonderful.h>
+
+	.arch	i186
+	.code16
+	.intel_syntax noprefix
+
+// high byte of SCR_ENTRY_PALETTE(UI_PAL_LIGHT)
+#define UI_PAL_LIGHT_HIGH (11 << 1)
+
+	// ax = destination, dx = tile prefix, cl = maximum tile count
+	// stack = string (far pointer)
+	.global ui_blit_puts
+	.align 2
+ui_blit_puts:
+	push	si
+	push	di
+	push	ds
+	push	es
+	push	bp
+	mov	bp, sp
+
+	// configure es:di = 0x0000:ax, ds:si = string, ah = prefix
+	mov	di, ax
+	xor	ax, ax
+	mov	es, ax
+	lds	si, [bp + 14]
+	mov	ah, dh
+	xor	ch, ch
+	jcxz	ui_blit_puts_done
+	cld
+
+	.align 2, 0x90
+ui_blit_puts_loop:
+	lodsb
+	cmp	al, 0x05
+	jbe	ui_blit_puts_control
+ui_blit_puts_store:
+	stosw
+	loop	ui_blit_puts_loop
+
+ui_blit_puts_done:
+	pop	bp
+	pop	es
+	pop	ds
+	pop	di
+	pop	si
+	ASM_PLATFORM_RET 0x4
+
+ui_blit_puts_control:
+	test	al, al
+	jz	ui_blit_puts_done
+	cmp	al, 0x05
+	jne	ui_blit_puts_store
+	// light text marker - only applies to the default palette
+	test	dh, dh
+	jnz	ui_blit_puts_loop
+	mov	ah, UI_PAL_LIGHT_HIGH
+	jmp	ui_blit_puts_loop
+
+	// ax = destination, dx = tile, cl = width
+	// stack = height
+	.global ui_blit_fill
+	.align 2
+ui_blit_fill:
+	push	si
+	push	di
+	push	es
+	push	bp
+	mov	bp, sp
+
+	// configure es:di = 0x0000:ax, ax = tile, dx = width,
+	// si = bytes between the end of a row and the start of the next one
+	mov	di, ax
+	xor	ax, ax
+	mov	es, ax
+	mov	ax, dx
+	xor	ch, ch
+	jcxz	ui_blit_fill_done
+	mov	dx, cx
+	mov	si, 32
+	sub	si, cx
+	shl	si, 1
+	mov	bl, [bp + 12]
+	test	bl, bl
+	jz	ui_blit_fill_done
+	cld
+
+	.align 2, 0x90
+ui_blit_fill_row:
+	mov	cx, dx
+	rep	stosw
+	add	di, si
+	dec	bl
+	jnz	ui_blit_fill_row
+
+ui_blit_fill_done:
+	pop	bp
+	pop	es
+	pop	di
+	pop	si
+	ASM_PLATFORM_RET 0x2
+
+	// dx:ax = source (1bpp font data), cx = destination
+	// stack = source length in bytes, a multiple of 8
+	// Expands each byte to a 2bpp tile row with a zero second plane.
+	.global ui_font_expand
+	.align 2
+ui_font_expand:
+	push	si
+	push	di
+	push	ds
+	push	es
+	push	bp
+	mov	bp, sp
+
+	// configure ds:si = dx:ax, es:di = 0x0000:cx, cx = glyph count
+	mov	si, ax
+	mov	ds, dx
+	mov	di, cx
+	xor	ax, ax
+	mov	es, ax
+	mov	cx, [bp + 14]
+	shr	cx, 3
+	jcxz	ui_font_expand_done
+	cld
+
+	// ah stays zero
+	.align 2, 0x90
+ui_font_expand_loop:
+.rept 8
+	lodsb
+	stosw
+.endr
+	loop	ui_font_expand_loop
+
+ui_font_expand_done:
+	pop	bp
+	pop	es
+	pop	ds
+	pop	di
+	pop	si
+	ASM_PLATFORM_RET 0x2
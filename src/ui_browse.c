@@ -16,11 +16,12 @@
  */
 
 #include <stdint.h>
-#include <stdio.h>
 #include <string.h>
 #include <ws.h>
+#include "catalog.h"
 #include "config.h"
 #include "driver.h"
+#include "format.h"
 #include "input.h"
 #include "lang.h"
 #include "settings.h"
@@ -33,156 +34,230 @@
 #define BROWSE_SUB_LAUNCH 0
 #define BROWSE_SUB_INFO 1
 #define BROWSE_SUB_RENAME 2
+#define BROWSE_SUB_RESCAN 3
+#define BROWSE_SUB_SEARCH 4
+#define BROWSE_SUB_SORT 5
 
-// in mbits
-static const uint8_t __far rom_size_table[] = {
-    1, 2, 4, 8, 16, 24, 32, 48, 62, 128
-};
+#define BROWSE_SORT_SLOT 0
+#define BROWSE_SORT_NAME 1
+#define BROWSE_SORT_RECENT 2
+#define BROWSE_SORT_COUNT 3
+
+#define BROWSE_FILTER_LEN 12
 
-static void ui_browse_menu_build_line(uint8_t entry_id, void *userdata, char *buf, int buf_len, char *buf_right, int buf_right_len) {
+// The Browse menu is a virtual menu over an index of catalog entries, which
+// is filtered and sorted in RAM - this never requires reading from flash.
+static uint8_t browse_index[CATALOG_MAX_ENTRIES];
+static uint8_t browse_sort = BROWSE_SORT_SLOT;
+static char browse_filter[BROWSE_FILTER_LEN + 1];
+
+static inline uint8_t ui_browse_row_to_entry(uint16_t row) {
+    return browse_index[row];
+}
+
+static void ui_browse_menu_build_line(uint16_t row, void *userdata, char *buf, int buf_len, char *buf_right, int buf_right_len) {
     char buf_name[28];
-    uint8_t *cart_metadata = (uint8_t*) userdata;
+    uint8_t entry_id = ui_browse_row_to_entry(row);
+
+    if (entry_id < settings_local.catalog.count) {
+        const catalog_entry_t *entry = settings_local.catalog.entries + entry_id;
+        uint8_t id = entry->id;
 
-    if (entry_id < 128) {
-        if (entry_id < GAME_SLOTS && settings_local.slot_name[entry_id][0] >= 0x20) {
-            _nmemcpy(buf_name, settings_local.slot_name[entry_id] + 1, 23);
+        if (id < GAME_SLOTS && settings_local.slot_name[id][0] >= 0x20) {
+            _nmemcpy(buf_name, settings_local.slot_name[id] + 1, 23);
             buf_name[23] = 0;
         } else if (settings_local.flags1 & SETT_FLAGS1_HIDE_SLOT_IDS) {
             buf_name[0] = 0;
         } else {
-            snprintf(buf_name, sizeof(buf_name), lang_keys[LK_UI_BROWSE_SLOT_DEFAULT_NAME],
-                (uint16_t) cart_metadata[(entry_id*5) + 4],
-                (uint16_t) cart_metadata[(entry_id*5)],     (uint16_t) cart_metadata[(entry_id*5) + 1],
-                (uint16_t) cart_metadata[(entry_id*5) + 2], (uint16_t) cart_metadata[(entry_id*5) + 3]
+            format_snprintf(buf_name, sizeof(buf_name), lang_get(LK_UI_BROWSE_SLOT_DEFAULT_NAME),
+                (uint16_t) entry->publisher_id,
+                (uint16_t) entry->game_id, (uint16_t) entry->game_version,
+                (uint16_t) (entry->checksum >> 8), (uint16_t) (entry->checksum & 0xFF)
             );
         }
-        uint8_t sub_slot = entry_id >> 4;
-        entry_id &= 0xF;
-        snprintf(buf, buf_len, lang_keys[LK_UI_BROWSE_SLOT], (uint16_t) (entry_id + 1), sub_slot == 0 ? ' ' : ('A' + sub_slot - 1), ((const char __far*) buf_name));
+        uint8_t sub_slot = id >> 4;
+        id &= 0xF;
+        format_snprintf(buf, buf_len, lang_get(LK_UI_BROWSE_SLOT), (uint16_t) (id + 1), sub_slot == 0 ? ' ' : ('A' + sub_slot - 1), ((const char __far*) buf_name));
+        if (entry->flags & CATALOG_ENTRY_CORRUPT) {
+            strncpy(buf_right, lang_get(LK_UI_BROWSE_SLOT_CORRUPT), buf_right_len);
+        }
     }
 }
 
+// Interrupts are disabled while a slot is mounted, so each idle frame only
+// sums a few KB; VBlank is held back by about a frame at most.
+#define BROWSE_VERIFY_IDLE_BLOCKS 16
+
+static bool ui_browse_menu_idle(void *userdata) {
+    // Verify installed software in the background; pressing a key hands
+    // control back right away.
+    return catalog_verify_step(0xFF, BROWSE_VERIFY_IDLE_BLOCKS, true);
+}
+
 static uint16_t __far browse_sub_lks[] = {
     LK_UI_BROWSE_POPUP_LAUNCH,
     LK_UI_BROWSE_POPUP_INFO,
-    LK_UI_BROWSE_POPUP_RENAME
+    LK_UI_BROWSE_POPUP_RENAME,
+    LK_UI_BROWSE_POPUP_RESCAN,
+    LK_UI_BROWSE_POPUP_SEARCH,
+    LK_UI_BROWSE_POPUP_SORT
+};
+
+static uint16_t __far browse_sort_lks[] = {
+    LK_UI_BROWSE_SORT_SLOT,
+    LK_UI_BROWSE_SORT_NAME,
+    LK_UI_BROWSE_SORT_RECENT
 };
 
 static void ui_browse_submenu_build_line(uint8_t entry_id, void *userdata, char *buf, int buf_len) {
-    strncpy(buf, lang_keys[browse_sub_lks[entry_id]], buf_len);
+    if (entry_id == BROWSE_SUB_SORT) {
+        format_snprintf(buf, buf_len, lang_get(LK_UI_BROWSE_POPUP_SORT), (const char __far*) lang_get(browse_sort_lks[browse_sort]));
+    } else {
+        strncpy(buf, lang_get(browse_sub_lks[entry_id]), buf_len);
+    }
 }
 
-static void ui_browse_save_select_build_line(uint8_t entry_id, void *userdata, char *buf, int buf_len, char *buf_right, int buf_right_len) {
-    snprintf(buf, buf_len, lang_keys[LK_UI_BROWSE_USE_SRAM], entry_id + 'A');
+static void ui_browse_save_select_build_line(uint16_t entry_id, void *userdata, char *buf, int buf_len, char *buf_right, int buf_right_len) {
+    format_snprintf(buf, buf_len, lang_get(LK_UI_BROWSE_USE_SRAM), entry_id + 'A');
 }
 
-static bool ui_read_rom_header(void *buffer, uint8_t slot, uint8_t bank) {
-    return driver_read_slot(buffer, slot, bank, 0xFFF0, 16);
+static const char *ui_browse_entry_name(const catalog_entry_t *entry) {
+    if (entry->id < GAME_SLOTS && settings_local.slot_name[entry->id][0] >= 0x20) {
+        return (const char*) (settings_local.slot_name[entry->id] + 1);
+    }
+    return NULL;
 }
 
-static inline bool ui_read_rom_header_from_entry(void *buffer, uint8_t entry_id) {
-    return ui_read_rom_header(buffer, entry_id & 0x0F, 0xFF - (entry_id & 0xF0));
+static inline char ui_browse_lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? (c + 32) : c;
 }
 
-static bool is_valid_rom_header(uint8_t *buffer) {
-    // is the first byte a valid jump call?
-    if (buffer[0] == 0xEA || buffer[0] == 0x9A) {
-        // are maintenance bits not set?
-        if (!(buffer[5] & 0x0F)) {
-            // is the target plausibly outside of internal RAM?
-            uint16_t dest_high = *((uint16_t*) (buffer + 3));
-            if (dest_high != 0xFFFF && dest_high != 0x0000) {
-                return true;
-            }
+static bool ui_browse_str_contains(const char *haystack, uint8_t haystack_len, const char *needle) {
+    for (uint8_t i = 0; i < haystack_len && haystack[i] != 0; i++) {
+        uint8_t j = 0;
+        while (needle[j] != 0 && (i + j) < haystack_len
+            && ui_browse_lower(haystack[i + j]) == ui_browse_lower(needle[j])) {
+            j++;
         }
+        if (needle[j] == 0) return true;
     }
     return false;
 }
 
-static uint8_t iterate_carts(uint8_t *menu_list, uint8_t *cart_metadata, uint8_t i) {
-    uint8_t buffer[16];
+static void ui_browse_put_hex(char *buf, uint8_t value) {
+    buf[0] = "0123456789ABCDEF"[value >> 4];
+    buf[1] = "0123456789ABCDEF"[value & 0x0F];
+}
 
-    ui_step_work_indicator();
-    driver_unlock();
-    for (uint8_t slot = 0; slot < GAME_SLOTS; slot++) {
-        ui_step_work_indicator();
-        if (settings_local.slot_type[slot] == SLOT_TYPE_UNUSED) {
-            continue;
+static bool ui_browse_entry_matches(const catalog_entry_t *entry, const char *filter) {
+    char buf[7];
+
+    if (filter[0] == 0) return true;
+
+    const char *name = ui_browse_entry_name(entry);
+    if (name != NULL && ui_browse_str_contains(name, 23, filter)) {
+        return true;
+    }
+
+    // also match the publisher/game/version IDs, as shown for unnamed slots
+    ui_browse_put_hex(buf, entry->publisher_id);
+    ui_browse_put_hex(buf + 2, entry->game_id);
+    ui_browse_put_hex(buf + 4, entry->game_version);
+    buf[6] = 0;
+    return ui_browse_str_contains(buf, 6, filter);
+}
+
+static uint8_t ui_browse_recent_rank(const catalog_entry_t *entry) {
+    uint8_t i;
+    for (i = 0; i < RECENT_MAX; i++) {
+        if (settings_local.recent[i] == entry->id) break;
+    }
+    return i;
+}
+
+// returns a negative value if a should be listed before b
+static int ui_browse_compare(uint8_t a, uint8_t b) {
+    const catalog_entry_t *ea = settings_local.catalog.entries + a;
+    const catalog_entry_t *eb = settings_local.catalog.entries + b;
+
+    if (browse_sort == BROWSE_SORT_NAME) {
+        const char *na = ui_browse_entry_name(ea);
+        const char *nb = ui_browse_entry_name(eb);
+        // named software goes first, the rest is ordered by its IDs
+        if (na != NULL && nb != NULL) {
+            for (uint8_t i = 0; i < 23; i++) {
+                int diff = ui_browse_lower(na[i]) - ui_browse_lower(nb[i]);
+                if (diff != 0 || na[i] == 0) return diff;
+            }
+            return 0;
+        } else if (na != NULL || nb != NULL) {
+            return na != NULL ? -1 : 1;
         }
+        int diff = ea->publisher_id - eb->publisher_id;
+        if (diff == 0) diff = ea->game_id - eb->game_id;
+        return diff;
+    } else if (browse_sort == BROWSE_SORT_RECENT) {
+        return ui_browse_recent_rank(ea) - ui_browse_recent_rank(eb);
+    }
+    return 0;
+}
 
-        if (driver_get_launch_slot() == slot) {
+static uint8_t build_menu_rows(void) {
+    uint8_t count = 0;
+    for (uint8_t j = 0; j < settings_local.catalog.count; j++) {
+        const catalog_entry_t *entry = settings_local.catalog.entries + j;
+        if (driver_get_launch_slot() == catalog_entry_slot(entry->id)) {
             // if booted from RAM/SRAM, don't skip launch slot
-            if (_CS >= 0x2000) {
+            if (_CS < 0x2000) {
                 continue;
             }
         }
+        if (!ui_browse_entry_matches(entry, browse_filter)) {
+            continue;
+        }
 
-        int16_t bank = 0xFF;
-        while (bank >= 0x80) {
-            _nmemset(buffer, 0xFF, sizeof(buffer));
-            if (ui_read_rom_header(buffer, slot, bank)) {
-                if (is_valid_rom_header(buffer)) {
-                    uint8_t entry_id = slot | ((bank & 0xF0) ^ 0xF0);
-                    if (!(settings_local.flags1 & SETT_FLAGS1_HIDE_SLOT_IDS)) {
-                        uint16_t j = entry_id*5;
-                        cart_metadata[j++] = buffer[0x08];
-                        cart_metadata[j++] = buffer[0x09];
-                        cart_metadata[j++] = buffer[0x0F];
-                        cart_metadata[j++] = buffer[0x0E];
-                        cart_metadata[j] = buffer[0x06];
-                    }
-                    menu_list[i++] = entry_id;
-
-                    if (settings_local.slot_type[slot] == SLOT_TYPE_MULTILINEAR_SOFT) {
-                        if (buffer[10] < sizeof(rom_size_table)) {
-                            uint16_t size_banks = ((uint16_t) rom_size_table[buffer[10]]) * 2;
-                            if (size_banks < 16) size_banks = 16;
-                            bank -= size_banks;
-                            continue;
-                        } else {
-                            break;
-                        }
-                    }
-                }
-            }
-            break;
+        // insertion sort; ties keep catalog (slot) order
+        uint8_t i = count++;
+        while (i > 0 && ui_browse_compare(j, browse_index[i - 1]) < 0) {
+            browse_index[i] = browse_index[i - 1];
+            i--;
         }
+        browse_index[i] = j;
     }
-    driver_lock();
-
-    return i;
+    return count;
 }
 
-void ui_browse_info(uint8_t slot) {
+void ui_browse_info(uint8_t entry_id) {
     char buf[32], buf2[24];
     uint8_t rom_header[16];
+    const catalog_entry_t *entry = settings_local.catalog.entries + entry_id;
 
     driver_unlock();
     ui_reset_main_screen();
-    ui_read_rom_header_from_entry(rom_header, slot);
+    catalog_read_rom_header(rom_header, entry->id);
     driver_lock();
     input_wait_clear();
 
-    snprintf(buf, sizeof(buf), lang_keys[LK_UI_BROWSE_INFO_ID_VAL],
+    format_snprintf(buf, sizeof(buf), lang_get(LK_UI_BROWSE_INFO_ID_VAL),
         (uint16_t) rom_header[6],
         (uint16_t) rom_header[8],
         (uint16_t) rom_header[9]);
-    ui_bg_printf(0, 1, 0, lang_keys[LK_UI_BROWSE_INFO_ID], (const char __far*) buf);
+    ui_bg_printf(0, 1, 0, lang_get(LK_UI_BROWSE_INFO_ID), (const char __far*) buf);
 
     if (rom_header[10] >= sizeof(rom_size_table)) {
-        strncpy(buf, lang_keys[LK_UI_BROWSE_INFO_UNKNOWN], sizeof(buf));
+        strncpy(buf, lang_get(LK_UI_BROWSE_INFO_UNKNOWN), sizeof(buf));
     } else {
-        snprintf(buf, sizeof(buf), lang_keys[LK_UI_BROWSE_INFO_ROM_SIZE_MBIT],
+        format_snprintf(buf, sizeof(buf), lang_get(LK_UI_BROWSE_INFO_ROM_SIZE_MBIT),
             (uint16_t) rom_size_table[rom_header[10]]);
     }
 
-    ui_bg_printf(0, 2, 0, lang_keys[LK_UI_BROWSE_INFO_ROM_SIZE], (const char __far*) buf);
+    ui_bg_printf(0, 2, 0, lang_get(LK_UI_BROWSE_INFO_ROM_SIZE), (const char __far*) buf);
 
-    ui_puts(false, 0, 3, 0, lang_keys[LK_UI_BROWSE_INFO_SAVE_TYPE]);
-    uint8_t save_str_x = 1 + strlen(lang_keys[LK_UI_BROWSE_INFO_SAVE_TYPE]);
+    ui_puts(false, 0, 3, 0, lang_get(LK_UI_BROWSE_INFO_SAVE_TYPE));
+    uint8_t save_str_x = 1 + strlen(lang_get(LK_UI_BROWSE_INFO_SAVE_TYPE));
     uint8_t save_str_y = 3;
     if (rom_header[11] == 0x00) {
-        ui_puts(false, save_str_x, save_str_y, 0, lang_keys[LK_UI_BROWSE_INFO_NONE]);
+        ui_puts(false, save_str_x, save_str_y, 0, lang_get(LK_UI_BROWSE_INFO_NONE));
     } else {
         if (rom_header[11] & 0x0F) {
             uint16_t kbit = 0;
@@ -194,11 +269,11 @@ void ui_browse_info(uint8_t slot) {
             case 0x5: kbit = 4096; break;
             }
             if (kbit == 0) {
-                strncpy(buf, lang_keys[LK_UI_BROWSE_INFO_UNKNOWN], sizeof(buf));
+                strncpy(buf, lang_get(LK_UI_BROWSE_INFO_UNKNOWN), sizeof(buf));
             } else {
-                snprintf(buf, sizeof(buf), lang_keys[LK_UI_BROWSE_INFO_DECIMAL], kbit);
+                format_snprintf(buf, sizeof(buf), lang_get(LK_UI_BROWSE_INFO_DECIMAL), kbit);
             }
-            ui_bg_printf(save_str_x, save_str_y++, 0, lang_keys[LK_UI_BROWSE_INFO_SAVE_TYPE_SRAM], (const char __far*) buf);
+            ui_bg_printf(save_str_x, save_str_y++, 0, lang_get(LK_UI_BROWSE_INFO_SAVE_TYPE_SRAM), (const char __far*) buf);
         }
         if (rom_header[11] & 0xF0) {
             uint16_t kbit = 0;
@@ -208,32 +283,36 @@ void ui_browse_info(uint8_t slot) {
             case 0x5: kbit = 8; break;
             }
             if (kbit == 0) {
-                strncpy(buf, lang_keys[LK_UI_BROWSE_INFO_UNKNOWN], sizeof(buf));
+                strncpy(buf, lang_get(LK_UI_BROWSE_INFO_UNKNOWN), sizeof(buf));
             } else {
-                snprintf(buf, sizeof(buf), lang_keys[LK_UI_BROWSE_INFO_DECIMAL], kbit);
+                format_snprintf(buf, sizeof(buf), lang_get(LK_UI_BROWSE_INFO_DECIMAL), kbit);
             }
-            ui_bg_printf(save_str_x, save_str_y++, 0, lang_keys[LK_UI_BROWSE_INFO_SAVE_TYPE_EEPROM], (const char __far*) buf);
+            ui_bg_printf(save_str_x, save_str_y++, 0, lang_get(LK_UI_BROWSE_INFO_SAVE_TYPE_EEPROM), (const char __far*) buf);
         }
     }
 
-    ui_bg_printf(0, 5, 0, lang_keys[LK_UI_BROWSE_INFO_COLOR], (const char __far*) lang_keys[
+    ui_bg_printf(0, 5, 0, lang_get(LK_UI_BROWSE_INFO_COLOR), (const char __far*) lang_get(
         rom_header[7] > 1 ? LK_UI_BROWSE_INFO_UNKNOWN : (rom_header[7] ? LK_CONFIG_YES : LK_CONFIG_NO)
-    ]);
-    ui_bg_printf(0, 6, 0, lang_keys[LK_UI_BROWSE_INFO_ORIENTATION], (const char __far*) lang_keys[
+    ));
+    ui_bg_printf(0, 6, 0, lang_get(LK_UI_BROWSE_INFO_ORIENTATION), (const char __far*) lang_get(
         rom_header[12] & 0x01 ? LK_UI_BROWSE_INFO_VERTICAL : LK_UI_BROWSE_INFO_HORIZONTAL
-    ]);
+    ));
 
-    ui_bg_printf(0, 8, 0, lang_keys[LK_UI_BROWSE_INFO_RTC], (const char __far*) lang_keys[
+    ui_bg_printf(0, 8, 0, lang_get(LK_UI_BROWSE_INFO_RTC), (const char __far*) lang_get(
         rom_header[13] & 0x01 ? LK_CONFIG_YES : LK_CONFIG_NO
-    ]);
-    ui_bg_printf(0, 9, 0, lang_keys[LK_UI_BROWSE_INFO_EEPROM], (const char __far*) lang_keys[
+    ));
+    ui_bg_printf(0, 9, 0, lang_get(LK_UI_BROWSE_INFO_EEPROM), (const char __far*) lang_get(
         rom_header[9] & 0x80 ? LK_CONFIG_YES : LK_CONFIG_NO
-    ]);
+    ));
 
-    ui_puts(false, 0, 11, 0, lang_keys[(rom_header[12] & 0x04) ? LK_UI_BROWSE_INFO_ROM_SPEED_1 : LK_UI_BROWSE_INFO_ROM_SPEED_3]);
-    ui_bg_printf(0, 12, 0, lang_keys[LK_UI_BROWSE_INFO_ROM_BUS_SIZE], (uint16_t) ((rom_header[12] & 0x02) ? 8 : 16));
+    ui_puts(false, 0, 11, 0, lang_get((rom_header[12] & 0x04) ? LK_UI_BROWSE_INFO_ROM_SPEED_1 : LK_UI_BROWSE_INFO_ROM_SPEED_3));
+    ui_bg_printf(0, 12, 0, lang_get(LK_UI_BROWSE_INFO_ROM_BUS_SIZE), (uint16_t) ((rom_header[12] & 0x02) ? 8 : 16));
 
-    ui_bg_printf(0, 14, 0, lang_keys[LK_UI_BROWSE_INFO_CHECKSUM], (uint16_t) rom_header[15], (uint16_t) rom_header[14]);
+    ui_bg_printf(0, 14, 0, lang_get(LK_UI_BROWSE_INFO_CHECKSUM), (uint16_t) rom_header[15], (uint16_t) rom_header[14], (const char __far*) lang_get(
+        !(entry->flags & CATALOG_ENTRY_CHECKED) ? LK_UI_BROWSE_INFO_CHECKSUM_UNCHECKED :
+        (entry->flags & CATALOG_ENTRY_UNVERIFIABLE) ? LK_UI_BROWSE_INFO_CHECKSUM_UNVERIFIABLE :
+        (entry->flags & CATALOG_ENTRY_CORRUPT ? LK_UI_BROWSE_INFO_CHECKSUM_BAD : LK_UI_BROWSE_INFO_CHECKSUM_OK)
+    ));
 
     while (ui_poll_events()) {
         wait_for_vblank();
@@ -241,69 +320,242 @@ void ui_browse_info(uint8_t slot) {
     }
 }
 
+// The Browse tab is re-entered after every dialog and tab switch; keep its
+// menu (and cursor) around, only rebuilding it when the catalog changes.
+static ui_menu_state_t browse_menu = {
+    .list = NULL,
+    .build_line_func = ui_browse_menu_build_line,
+    .idle_func = ui_browse_menu_idle,
+    .flags = MENU_B_AS_ACTION
+};
+static bool browse_menu_valid = false;
+
+static void ui_browse_rebuild_menu(void) {
+    uint8_t last_id = 0xFF;
+    if (browse_menu_valid && browse_menu.height > 0) {
+        last_id = settings_local.catalog.entries[ui_browse_row_to_entry(browse_menu.pos)].id;
+    }
+
+    browse_menu.height = build_menu_rows();
+
+    // try to keep the cursor on the same software
+    uint16_t pos = browse_menu.pos;
+    for (uint16_t i = 0; i < browse_menu.height; i++) {
+        if (settings_local.catalog.entries[ui_browse_row_to_entry(i)].id == last_id) {
+            pos = i;
+            break;
+        }
+    }
+
+    ui_menu_init(&browse_menu);
+    ui_menu_set_pos(&browse_menu, pos);
+    browse_menu_valid = true;
+    // a pre-rendered page shows the old rows
+    ui_page_invalidate();
+}
+
+static void ui_browse_update_menu(void) {
+    bool refreshed = catalog_refresh();
+    if (browse_menu_valid && !refreshed) {
+        return;
+    }
+    if (refreshed && (settings_local.catalog.flags & CATALOG_TRUNCATED)) {
+        ui_dialog_run(0, 0, LK_DIALOG_CATALOG_TRUNCATED, LK_DIALOG_OK);
+        ui_reset_main_screen();
+    }
+    ui_browse_rebuild_menu();
+}
+
+bool ui_browse_prerender(void) {
+    if (!browse_menu_valid || !catalog_is_current()) {
+        return false;
+    }
+    ui_menu_draw(&browse_menu);
+    return true;
+}
+
+static void ui_browse_search_changed(const char *buf, void *userdata) {
+    memcpy(browse_filter, buf, BROWSE_FILTER_LEN);
+    ui_browse_rebuild_menu();
+    ui_reset_main_screen();
+    ui_menu_draw(&browse_menu);
+}
+
+static void ui_browse_search(void) {
+    char query[BROWSE_FILTER_LEN + 1];
+    char last_filter[BROWSE_FILTER_LEN + 1];
+
+    memcpy(last_filter, browse_filter, sizeof(browse_filter));
+    memcpy(query, browse_filter, sizeof(browse_filter));
+    if (!ui_osk_run(0, query, BROWSE_FILTER_LEN, ui_browse_search_changed, NULL)) {
+        memcpy(browse_filter, last_filter, sizeof(browse_filter));
+    } else if (browse_menu.height == 0) {
+        // nothing matched - don't leave the user with an empty list
+        browse_filter[0] = 0;
+    }
+    ui_browse_rebuild_menu();
+}
+
+void ui_browse_launch(uint8_t id, const uint8_t *rom_header) {
+    // does the game leave IEEPROM unlocked?
+    if (!(rom_header[0x09] & 0x80)) {
+        // lock IEEPROM
+        outportw(IO_IEEP_CTRL, IEEP_PROTECT);
+    }
+
+    settings_mark_launched(id);
+    // Relaunching the most recent ROM changes no settings, so launch_slot()
+    // would not store the result of verifying it. If anything did change,
+    // this leaves the write to launch_slot().
+    catalog_flush();
+    launch_slot(catalog_entry_slot(id), catalog_entry_bank(id));
+}
+
+void ui_browse_quick_resume(void) {
+    const catalog_t *catalog = &settings_local.catalog;
+    uint8_t rom_header[16];
+    uint8_t id = settings_local.recent[0];
+
+    if (id == RECENT_NONE || catalog->count == CATALOG_COUNT_INVALID || catalog->generation != settings_local.slot_generation) {
+        return;
+    }
+
+    const catalog_entry_t *entry = NULL;
+    for (uint8_t i = 0; i < catalog->count; i++) {
+        if (catalog->entries[i].id == id) {
+            entry = catalog->entries + i;
+            break;
+        }
+    }
+    if (entry == NULL || (entry->flags & CATALOG_ENTRY_CORRUPT)) {
+        return;
+    }
+
+    _nmemset(rom_header, 0xFF, sizeof(rom_header));
+    driver_unlock();
+    catalog_read_rom_header(rom_header, id);
+    driver_lock();
+    if (!catalog_entry_matches_header(entry, rom_header)) {
+        return;
+    }
+
+    // does the game use save data?
+    if (rom_header[0x0B] != 0 && _CS >= 0x2000) {
+        uint8_t sram_slot = settings_local.active_sram_slot;
+        if (sram_slot == SRAM_SLOT_FIRST_BOOT) {
+            return;
+        }
+        if (sram_slot >= SRAM_SLOTS || settings_local.sram_slot_mapping[sram_slot] != id) {
+            // the active save block is not this game's - pick its only one
+            sram_slot = SRAM_SLOT_NONE;
+            for (uint8_t k = 0; k < SRAM_SLOTS; k++) {
+                if (settings_local.sram_slot_mapping[k] == id) {
+                    // more than one to choose from - let the user decide
+                    if (sram_slot != SRAM_SLOT_NONE) return;
+                    sram_slot = k;
+                }
+            }
+        }
+        sram_switch_to_slot(sram_slot);
+    }
+
+    ui_browse_launch(id, rom_header);
+}
+
 void ui_browse(void) {
-    uint8_t menu_list[256];
-    uint8_t cart_metadata[640];
-    uint8_t i = 0;
-
-    i = iterate_carts(menu_list, cart_metadata, i);
-    menu_list[i++] = MENU_ENTRY_END;
-
-    ui_menu_state_t menu = {
-        .list = menu_list,
-        .build_line_func = ui_browse_menu_build_line,
-        .build_line_data = cart_metadata,
-        .flags = MENU_B_AS_ACTION
-    };
-    ui_menu_init(&menu);
-
-    uint16_t result = ui_menu_select(&menu);
-    uint16_t subaction = 0;
-    if ((result & 0xFF) < 128) {
-        if ((result & 0xFF00) == MENU_ACTION_B) {
-            ui_popup_menu_state_t popup_menu = {
-                .list = menu_list,
-                .build_line_func = ui_browse_submenu_build_line,
-                .flags = 0
-            };
-            i = 0;
-            menu_list[i++] = BROWSE_SUB_LAUNCH;
-            menu_list[i++] = BROWSE_SUB_INFO;
-            menu_list[i++] = BROWSE_SUB_RENAME;
-            menu_list[i++] = MENU_ENTRY_END;
-            subaction = ui_popup_menu_run(&popup_menu);
+    uint8_t sub_list[SRAM_SLOTS + 1];
+    uint8_t rom_header[16];
+    uint8_t i;
+
+    ui_browse_update_menu();
+
+    uint16_t result = ui_menu_select(&browse_menu);
+    if (ui_current_tab != UI_TAB_BROWSE) {
+        catalog_flush();
+    }
+    bool has_entry = (result & 0xFF) == MENU_ENTRY_ROW;
+    uint16_t subaction = has_entry ? BROWSE_SUB_LAUNCH : MENU_ENTRY_END;
+    if ((result & 0xFF00) == MENU_ACTION_B) {
+        ui_popup_menu_state_t popup_menu = {
+            .list = sub_list,
+            .build_line_func = ui_browse_submenu_build_line,
+            .flags = 0
+        };
+        i = 0;
+        if (has_entry) {
+            sub_list[i++] = BROWSE_SUB_LAUNCH;
+            sub_list[i++] = BROWSE_SUB_INFO;
+            sub_list[i++] = BROWSE_SUB_RENAME;
         }
-        result &= 0xFF;
+        sub_list[i++] = BROWSE_SUB_SEARCH;
+        sub_list[i++] = BROWSE_SUB_SORT;
+        sub_list[i++] = BROWSE_SUB_RESCAN;
+        sub_list[i++] = MENU_ENTRY_END;
+        subaction = ui_popup_menu_run(&popup_menu);
+    }
+
+    if (subaction == BROWSE_SUB_SEARCH) {
+        ui_browse_search();
+    } else if (subaction == BROWSE_SUB_SORT) {
+        browse_sort = (browse_sort + 1) % BROWSE_SORT_COUNT;
+        ui_browse_rebuild_menu();
+    } else if (subaction == BROWSE_SUB_RESCAN) {
+        catalog_invalidate();
+    } else if (has_entry) {
+        uint8_t entry_id = ui_browse_row_to_entry(browse_menu.pos);
+        const catalog_entry_t *entry = settings_local.catalog.entries + entry_id;
+        result = entry->id;
 
         if (subaction == BROWSE_SUB_LAUNCH) {
             ui_reset_main_screen();
 
-            _nmemset(menu_list, 0xFF, 16);
-            ui_read_rom_header_from_entry(menu_list, result);
+            _nmemset(rom_header, 0xFF, sizeof(rom_header));
+            driver_unlock();
+            catalog_read_rom_header(rom_header, result);
+            driver_lock();
+
+            // was the slot rewritten behind our back?
+            if (!catalog_entry_matches_header(entry, rom_header)) {
+                catalog_invalidate();
+                if (!catalog_is_valid_rom_header(rom_header)) {
+                    return;
+                }
+            }
+
+            // is the installed ROM intact?
+            if (!catalog_verify_entry(entry_id)) {
+                if (ui_dialog_run(0, 1, LK_DIALOG_ROM_CORRUPT, LK_DIALOG_YES_NO) != 0) {
+                    return;
+                }
+                ui_reset_main_screen();
+            }
 
             // does the game use save data?
-            if (menu_list[0x0B] != 0 && _CS >= 0x2000) {
+            if (rom_header[0x0B] != 0 && _CS >= 0x2000) {
                 // figure out SRAM slots
                 i = 0;
                 for (uint8_t k = 0; k < SRAM_SLOTS; k++) {
                     if (settings_local.sram_slot_mapping[k] == result) {
-                        menu_list[i++] = k;
+                        sub_list[i++] = k;
                     }
                 }
                 uint8_t sram_slot = 0xFF;
                 if (i > 1) {
-                    menu_list[i++] = MENU_ENTRY_END;
-                    menu.build_line_func = ui_browse_save_select_build_line;
-                    menu.flags = MENU_B_AS_BACK;
-                    ui_menu_init(&menu);
-                    uint16_t result_sram = ui_menu_select(&menu);
+                    sub_list[i++] = MENU_ENTRY_END;
+                    ui_menu_state_t sram_menu = {
+                        .list = sub_list,
+                        .build_line_func = ui_browse_save_select_build_line,
+                        .flags = MENU_B_AS_BACK
+                    };
+                    ui_menu_init(&sram_menu);
+                    uint16_t result_sram = ui_menu_select(&sram_menu);
                     if (result_sram == MENU_ENTRY_END) {
                         return;
                     } else {
-                        sram_slot = menu_list[result_sram & 0xFF];
+                        sram_slot = sub_list[result_sram & 0xFF];
                     }
                 } else if (i == 1) {
-                    sram_slot = menu_list[0];
+                    sram_slot = sub_list[0];
                 }
 
                 sram_switch_to_slot(sram_slot);
@@ -314,30 +566,27 @@ void ui_browse(void) {
                 }
             }
 
-            // does the game leave IEEPROM unlocked?
-            if (!(menu_list[0x09] & 0x80)) {
-                // lock IEEPROM
-                outportw(IO_IEEP_CTRL, IEEP_PROTECT);
-            }
-
             input_wait_clear();
-            launch_slot(result & 0x0F, 0xFF - (result & 0xF0));
+            ui_browse_launch(result, rom_header);
         } else if (subaction == BROWSE_SUB_INFO) {
-            ui_browse_info(result);
+            ui_browse_info(entry_id);
         } else if (subaction == BROWSE_SUB_RENAME) {
             if (result < GAME_SLOTS) {
+                char name[24];
+                name[23] = 0;
                 if (settings_local.slot_name[result][0] < 0x20) {
-                    menu_list[0] = 0;
+                    name[0] = 0;
                 } else {
-                    _nmemcpy(menu_list, settings_local.slot_name[result] + 1, 23);
+                    _nmemcpy(name, settings_local.slot_name[result] + 1, 23);
                 }
-                if (ui_osk_run(0, (char*) menu_list, 23)) {
+                if (ui_osk_run(0, name, 23, NULL, NULL)) {
                     _nmemset(settings_local.slot_name[result], 0, 24);
-                    if (menu_list[0] != 0) {
+                    if (name[0] != 0) {
                         settings_local.slot_name[result][0] = 0x20;
-                        strncpy((char*) (settings_local.slot_name[result] + 1), (char*) menu_list, 23);
+                        strncpy((char*) (settings_local.slot_name[result] + 1), name, 23);
                     }
                     settings_mark_changed();
+                    ui_browse_rebuild_menu();
                 }
             }
         }
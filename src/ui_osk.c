@@ -96,17 +96,17 @@ void ui_osk_draw(ui_osk_state_t *osk, uint8_t what) {
         }
         {
             bool active = osk->osk_x == 0 && osk->osk_y == 0xFF;
-            ui_puts(true, osk->xb, osk->y + 3 + osk->height * 2, active ? UI_PAL_DIALOGI : UI_PAL_DIALOG, lang_keys[LK_DIALOG_OK]);
+            ui_puts(true, osk->xb, osk->y + 3 + osk->height * 2, active ? UI_PAL_DIALOGI : UI_PAL_DIALOG, lang_get(LK_DIALOG_OK));
         }
         {
             bool active = osk->osk_x == 1 && osk->osk_y == 0xFF;
-            ui_puts(true, osk->xb + (osk->width * 2 - 1) - strlen(lang_keys[LK_DIALOG_CANCEL]),
-                osk->y + 3 + osk->height * 2, active ? UI_PAL_DIALOGI : UI_PAL_DIALOG, lang_keys[LK_DIALOG_CANCEL]);
+            ui_puts(true, osk->xb + (osk->width * 2 - 1) - strlen(lang_get(LK_DIALOG_CANCEL)),
+                osk->y + 3 + osk->height * 2, active ? UI_PAL_DIALOGI : UI_PAL_DIALOG, lang_get(LK_DIALOG_CANCEL));
         }
     }
 }
 
-bool ui_osk_run(uint16_t flags, char *buf, uint8_t buf_width) {
+bool ui_osk_run(uint16_t flags, char *buf, uint8_t buf_width, ui_osk_change_func change_func, void *userdata) {
     wait_for_vblank();
     ui_dialog_open = true;
     ui_update_theme(settings_local.color_theme);
@@ -135,7 +135,7 @@ bool ui_osk_run(uint16_t flags, char *buf, uint8_t buf_width) {
     osk.xt = (x + ((width - buf_width) >> 1));
     osk.xb = (x + ((width - (osk.width * 2 - 1)) >> 1));
     osk.y = 9 - ((height + 1) >> 1);
-    ws_screen_fill_tiles(SCREEN2, SCR_ENTRY_PALETTE(UI_PAL_DIALOG), x, osk.y, width, height);
+    ui_blit_fill(ui_screen_at(SCREEN2, x, osk.y), SCR_ENTRY_PALETTE(UI_PAL_DIALOG), width, height);
 
     // pre-draw some elements
     ui_fg_putc(osk.xt - 1, osk.y + 1, '[', UI_PAL_DIALOG);
@@ -248,6 +248,9 @@ bool ui_osk_run(uint16_t flags, char *buf, uint8_t buf_width) {
                     if (i < buf_width) *ptr = '\0';
                     to_draw |= OSK_DRAW_TEXT;
                 }
+                if ((to_draw & OSK_DRAW_TEXT) && change_func != NULL) {
+                    change_func(buf, userdata);
+                }
             }
         }
     }
@@ -15,11 +15,12 @@
  * with CartFriend. If not, see <https://www.gnu.org/licenses/>. 
  */
 
-#include <stdio.h>
 #include <string.h>
 #include <ws.h>
+#include "catalog.h"
 #include "config.h"
 #include "driver.h"
+#include "format.h"
 #include "input.h"
 #include "lang.h"
 #include "settings.h"
@@ -68,24 +69,24 @@ static uint16_t __far ui_theme_color_lks[] = {
     LK_THEME_C2
 };
 
-static void ui_opt_menu_build_line(uint8_t entry_id, void *userdata, char *buf, int buf_len, char *buf_right, int buf_right_len) {
+static void ui_opt_menu_build_line(uint16_t entry_id, void *userdata, char *buf, int buf_len, char *buf_right, int buf_right_len) {
     if (entry_id == MENU_OPT_SAVE) {
-        snprintf(buf, buf_len, lang_keys[settings_changed ? LK_MENU_MARKED : LK_MENU_UNMARKED], lang_keys[ui_opt_lks[entry_id]]);
+        format_snprintf(buf, buf_len, lang_get(settings_changed ? LK_MENU_MARKED : LK_MENU_UNMARKED), lang_get(ui_opt_lks[entry_id]));
     } else {
-        strncpy(buf, lang_keys[ui_opt_lks[entry_id]], buf_len);
+        strncpy(buf, lang_get(ui_opt_lks[entry_id]), buf_len);
         if (entry_id == MENU_OPT_HIDE_SLOT_IDS) {
             bool yes = settings_local.flags1 & SETT_FLAGS1_HIDE_SLOT_IDS;
-            strncpy(buf_right, lang_keys[yes ? LK_CONFIG_YES : LK_CONFIG_NO], buf_right_len);
+            strncpy(buf_right, lang_get(yes ? LK_CONFIG_YES : LK_CONFIG_NO), buf_right_len);
         } else if (entry_id == MENU_OPT_THEME) {
             if (ws_system_color_active()) {
-                strncpy(buf_right, lang_keys[ui_theme_color_lks[settings_local.color_theme & 0x7F]], buf_right_len);
+                strncpy(buf_right, lang_get(ui_theme_color_lks[settings_local.color_theme & 0x7F]), buf_right_len);
             } else {
-                strncpy(buf_right, lang_keys[(settings_local.color_theme & 0x80) ? LK_THEME_M1 : LK_THEME_M0], buf_right_len);
+                strncpy(buf_right, lang_get((settings_local.color_theme & 0x80) ? LK_THEME_M1 : LK_THEME_M0), buf_right_len);
             }
         } else if (entry_id == MENU_OPT_LANGUAGE) {
-            strncpy(buf_right, lang_keys[ui_lang_lks[settings_local.language]], buf_right_len);
+            strncpy(buf_right, lang_get(ui_lang_lks[settings_local.language]), buf_right_len);
         } else if (entry_id == MENU_OPT_TEXT_WIDTH) {
-            strncpy(buf_right, lang_keys[(settings_local.flags1 & SETT_FLAGS1_WIDE_SCREEN) ? LK_WIDTH_WIDE : LK_WIDTH_NARROW], buf_right_len);
+            strncpy(buf_right, lang_get((settings_local.flags1 & SETT_FLAGS1_WIDE_SCREEN) ? LK_WIDTH_WIDE : LK_WIDTH_NARROW), buf_right_len);
         }
 
         if (entry_id == MENU_OPT_SLOTMAP || entry_id == MENU_OPT_SAVEMAP || entry_id == MENU_OPT_SAVE_MANAGEMENT || entry_id == MENU_OPT_ADVANCED) {
@@ -101,7 +102,8 @@ typedef enum {
     MENU_ADV_BUFFERED_WRITES,
     MENU_ADV_UNLOCK_IEEP,
     MENU_ADV_SERIAL_RATE,
-    MENU_ADV_FORCE_FAST_SRAM
+    MENU_ADV_FORCE_FAST_SRAM,
+    MENU_ADV_QUICK_RESUME
 } ui_adv_id_t;
 
 static uint16_t __far ui_adv_lks[] = {
@@ -110,14 +112,15 @@ static uint16_t __far ui_adv_lks[] = {
     LK_UI_SETTINGS_UNLOCK_IEEP,
     LK_UI_SETTINGS_SERIAL_RATE,
     LK_UI_SETTINGS_FORCE_FAST_SRAM,
+    LK_UI_SETTINGS_QUICK_RESUME,
 };
 
 static void build_line_yesno(bool yes, char *buf_right, int buf_right_len) {
-    strncpy(buf_right, lang_keys[yes ? LK_CONFIG_YES : LK_CONFIG_NO], buf_right_len);
+    strncpy(buf_right, lang_get(yes ? LK_CONFIG_YES : LK_CONFIG_NO), buf_right_len);
 }
 
-static void ui_adv_menu_build_line(uint8_t entry_id, void *userdata, char *buf, int buf_len, char *buf_right, int buf_right_len) {
-    strncpy(buf, lang_keys[ui_adv_lks[entry_id]], buf_len);
+static void ui_adv_menu_build_line(uint16_t entry_id, void *userdata, char *buf, int buf_len, char *buf_right, int buf_right_len) {
+    strncpy(buf, lang_get(ui_adv_lks[entry_id]), buf_len);
     if (entry_id == MENU_ADV_FORCECARTSRAM) {
         build_line_yesno(settings_local.active_sram_slot == SRAM_SLOT_FIRST_BOOT, buf_right, buf_right_len);
     } else if (entry_id == MENU_ADV_BUFFERED_WRITES) {
@@ -126,20 +129,22 @@ static void ui_adv_menu_build_line(uint8_t entry_id, void *userdata, char *buf,
         build_line_yesno(settings_local.flags1 & SETT_FLAGS1_UNLOCK_IEEP_NEXT_BOOT, buf_right, buf_right_len);
     } else if (entry_id == MENU_ADV_SERIAL_RATE) {
         bool is9600 = settings_local.flags1 & SETT_FLAGS1_SERIAL_9600BPS;
-        strncpy(buf_right, lang_keys[is9600 ? LK_UI_SETTINGS_SERIAL_RATE_9600 : LK_UI_SETTINGS_SERIAL_RATE_38400], buf_right_len);
+        strncpy(buf_right, lang_get(is9600 ? LK_UI_SETTINGS_SERIAL_RATE_9600 : LK_UI_SETTINGS_SERIAL_RATE_38400), buf_right_len);
     } else if (entry_id == MENU_ADV_FORCE_FAST_SRAM) {
         build_line_yesno(settings_local.flags1 & SETT_FLAGS1_FORCE_FAST_SRAM, buf_right, buf_right_len);
+    } else if (entry_id == MENU_ADV_QUICK_RESUME) {
+        build_line_yesno(settings_local.flags1 & SETT_FLAGS1_QUICK_RESUME, buf_right, buf_right_len);
     }
 }
 
-static void ui_opt_menu_savemap_build_line(uint8_t entry_id, void *userdata, char *buf, int buf_len, char *buf_right, int buf_right_len) {
+static void ui_opt_menu_savemap_build_line(uint16_t entry_id, void *userdata, char *buf, int buf_len, char *buf_right, int buf_right_len) {
     if (entry_id < SRAM_SLOTS) {
-        snprintf(buf, buf_len, lang_keys[entry_id == settings_local.active_sram_slot ? LK_UI_SAVEMAP_SRAM_ACTIVE : LK_UI_SAVEMAP_SRAM], entry_id + 'A');
+        format_snprintf(buf, buf_len, lang_get(entry_id == settings_local.active_sram_slot ? LK_UI_SAVEMAP_SRAM_ACTIVE : LK_UI_SAVEMAP_SRAM), entry_id + 'A');
         uint8_t sram_target = settings_local.sram_slot_mapping[entry_id];
         if (sram_target < GAME_SLOTS) {
-            snprintf(buf_right, buf_right_len, lang_keys[LK_UI_SAVEMAP_SLOT], sram_target + 1);
+            format_snprintf(buf_right, buf_right_len, lang_get(LK_UI_SAVEMAP_SLOT), sram_target + 1);
         } else if (sram_target == 0xFF) {
-            strncpy(buf_right, lang_keys[LK_UI_SAVEMAP_UNUSED], buf_right_len);
+            strncpy(buf_right, lang_get(LK_UI_SAVEMAP_UNUSED), buf_right_len);
         }
     }
 }
@@ -163,18 +168,18 @@ static uint8_t ui_savemap_prev(uint8_t slot) {
     return 0xFF;
 }
 
-static void ui_opt_menu_slotmap_build_line(uint8_t entry_id, void *userdata, char *buf, int buf_len, char *buf_right, int buf_right_len) {
+static void ui_opt_menu_slotmap_build_line(uint16_t entry_id, void *userdata, char *buf, int buf_len, char *buf_right, int buf_right_len) {
     if (entry_id < GAME_SLOTS) {
-        snprintf(buf, buf_len, lang_keys[LK_UI_SLOTMAP_SLOT], entry_id + 1);
+        format_snprintf(buf, buf_len, lang_get(LK_UI_SLOTMAP_SLOT), entry_id + 1);
         uint8_t slot_type = settings_local.slot_type[entry_id];
         if (slot_type == SLOT_TYPE_SOFT) {
-            strncpy(buf_right, lang_keys[LK_UI_SLOTMAP_SOFT], buf_right_len);
+            strncpy(buf_right, lang_get(LK_UI_SLOTMAP_SOFT), buf_right_len);
         } else if (slot_type == SLOT_TYPE_LAUNCHER) {
-            strncpy(buf_right, lang_keys[LK_UI_SLOTMAP_LAUNCHER], buf_right_len);
+            strncpy(buf_right, lang_get(LK_UI_SLOTMAP_LAUNCHER), buf_right_len);
         } else if (slot_type == SLOT_TYPE_MULTILINEAR_SOFT) {
-            strncpy(buf_right, lang_keys[LK_UI_SLOTMAP_MULTILINEAR_SOFT], buf_right_len);
+            strncpy(buf_right, lang_get(LK_UI_SLOTMAP_MULTILINEAR_SOFT), buf_right_len);
         } else if (slot_type == SLOT_TYPE_UNUSED) {
-            strncpy(buf_right, lang_keys[LK_UI_SLOTMAP_UNUSED], buf_right_len);
+            strncpy(buf_right, lang_get(LK_UI_SLOTMAP_UNUSED), buf_right_len);
         }
     }
 }
@@ -194,15 +199,15 @@ static uint8_t ui_slotmap_next(uint8_t slot, uint8_t delta) {
     return slot;
 }
 
-static void ui_opt_menu_erase_sram_build_line(uint8_t entry_id, void *userdata, char *buf, int buf_len, char *buf_right, int buf_right_len) {
+static void ui_opt_menu_erase_sram_build_line(uint16_t entry_id, void *userdata, char *buf, int buf_len, char *buf_right, int buf_right_len) {
     if (entry_id < SRAM_SLOTS) {
-        snprintf(buf, buf_len, lang_keys[entry_id == settings_local.active_sram_slot ? LK_UI_ERASE_BLOCK_ACTIVE : LK_UI_ERASE_BLOCK], entry_id + 'A');
+        format_snprintf(buf, buf_len, lang_get(entry_id == settings_local.active_sram_slot ? LK_UI_ERASE_BLOCK_ACTIVE : LK_UI_ERASE_BLOCK), entry_id + 'A');
     } else if (entry_id == 0xEF) {
-        strncpy(buf, lang_keys[LK_UI_ERASE_ALL_SAVE_DATA], buf_len);
+        strncpy(buf, lang_get(LK_UI_ERASE_ALL_SAVE_DATA), buf_len);
     } else if (entry_id == 0xEE) {
-        strncpy(buf, lang_keys[LK_UI_ERASE_UNDO_SRAM], buf_len);
+        strncpy(buf, lang_get(LK_UI_ERASE_UNDO_SRAM), buf_len);
     } else if (entry_id == 0xED) {
-        strncpy(buf, lang_keys[LK_UI_ERASE_TEST_ALL_SAVE_DATA], buf_len);
+        strncpy(buf, lang_get(LK_UI_ERASE_TEST_ALL_SAVE_DATA), buf_len);
     }
 }
 
@@ -211,6 +216,9 @@ static void ui_settings_advanced(uint8_t *menu_list) {
     menu_list[i++] = MENU_ADV_FORCE_FAST_SRAM;
     menu_list[i++] = MENU_ADV_BUFFERED_WRITES;
     menu_list[i++] = MENU_ADV_SERIAL_RATE;
+#ifdef USE_SLOT_SYSTEM
+    menu_list[i++] = MENU_ADV_QUICK_RESUME;
+#endif
     // menu_list[i++] = MENU_ADV_CART_AVR_DELAY;
     menu_list[i++] = MENU_ADV_FORCECARTSRAM;
     menu_list[i++] = MENU_ADV_UNLOCK_IEEP;
@@ -252,6 +260,10 @@ Reselect:
         settings_local.flags1 ^= SETT_FLAGS1_FORCE_FAST_SRAM;
         settings_mark_changed();
         goto Reselect;
+    } else if (result == MENU_ADV_QUICK_RESUME) {
+        settings_local.flags1 ^= SETT_FLAGS1_QUICK_RESUME;
+        settings_mark_changed();
+        goto Reselect;
     } /* else if (result == MENU_ADV_CART_AVR_DELAY) {
         settings_local.avr_cart_delay += 5;
         if (settings_local.avr_cart_delay < MINIMUM_AVR_CART_DELAY) {
@@ -264,8 +276,7 @@ Reselect:
     } */
 }
 
-void ui_settings(void) {
-    uint8_t menu_list[32];
+static void ui_settings_menu_init(ui_menu_state_t *menu, uint8_t *menu_list) {
     uint8_t i = 0;
     menu_list[i++] = MENU_OPT_THEME;
     menu_list[i++] = MENU_OPT_TEXT_WIDTH;
@@ -290,12 +301,25 @@ void ui_settings(void) {
     }
     menu_list[i++] = MENU_ENTRY_END;
 
-    ui_menu_state_t menu = {
-        .list = menu_list,
-        .build_line_func = ui_opt_menu_build_line,
-        .flags = 0
-    };
-    ui_menu_init(&menu);
+    _nmemset(menu, 0, sizeof(ui_menu_state_t));
+    menu->list = menu_list;
+    menu->build_line_func = ui_opt_menu_build_line;
+    ui_menu_init(menu);
+}
+
+bool ui_settings_prerender(void) {
+    uint8_t menu_list[32];
+    ui_menu_state_t menu;
+    ui_settings_menu_init(&menu, menu_list);
+    ui_menu_draw(&menu);
+    return true;
+}
+
+void ui_settings(void) {
+    uint8_t menu_list[32];
+    uint8_t i;
+    ui_menu_state_t menu;
+    ui_settings_menu_init(&menu, menu_list);
     
 Reselect:
     ;
@@ -343,10 +367,10 @@ Reselect:
                 break;
             } else if (result & MENU_ACTION_LEFT) {
                 settings_local.slot_type[result & 0xFF] = ui_slotmap_next(settings_local.slot_type[result & 0xFF], sizeof(slotmap_order) - 1);
-                settings_mark_changed();
+                catalog_mark_slot_changed();
             } else {
                 settings_local.slot_type[result & 0xFF] = ui_slotmap_next(settings_local.slot_type[result & 0xFF], 1);
-                settings_mark_changed();
+                catalog_mark_slot_changed();
             }
         }
     } else if (result == MENU_OPT_HIDE_SLOT_IDS) {
@@ -399,15 +423,15 @@ SaveMgmtReselect:
             } else if (result == 0xED) {
                 // erase + test everything
                 ui_reset_main_screen();
-                ui_puts_centered(false, 1, 0, lang_keys[LK_UI_ERASE_TEST_LINE1]);
-                ui_puts_centered(false, 2, 0, lang_keys[LK_UI_PLEASE_WAIT]);
+                ui_puts_centered(false, 1, 0, lang_get(LK_UI_ERASE_TEST_LINE1));
+                ui_puts_centered(false, 2, 0, lang_get(LK_UI_PLEASE_WAIT));
                 for (int i = 0; i < SRAM_SLOTS; i++) {
                     ui_bg_putc(13 * (i / 10), 4 + (i % 10), 'A' + i, 0);
                 }
                 for (int i = 0; i < SRAM_SLOTS; i++) {
                     test_save_read_write(13 * (i / 10) + 2, 4 + (i % 10), i);
                 }
-                ui_puts_centered(false, 2, 0, lang_keys[LK_UI_PRESS_ANY_KEY]);
+                ui_puts_centered(false, 2, 0, lang_get(LK_UI_PRESS_ANY_KEY));
                 input_wait_any_key();
                 settings_mark_changed();
             } else {
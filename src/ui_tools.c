@@ -16,21 +16,34 @@
  */
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <string.h>
 #include <wonderful.h>
 #include <ws.h>
+#include "catalog.h"
+#include "config.h"
 #include "driver.h"
+#include "format.h"
 #include "lang.h"
+#include "remote.h"
 #include "settings.h"
 #include "sram.h"
 #include "ui.h"
+#include "unpack.h"
 #include "util.h"
 #include "ws/hardware.h"
 #include "ws/system.h"
 #include "xmodem.h"
+#include "xmodem_flash.h"
 #include "../res/wsmonitor.h"
 
 typedef enum {
+    MENU_TOOL_INSTALL_XM,
+    MENU_TOOL_DELTA_XM,
+    MENU_TOOL_DUMP_ROM_XM,
+    MENU_TOOL_DUMP_SAVE_XM,
+    MENU_TOOL_IMPORT_SAVE_XM,
+    MENU_TOOL_REMOTE,
     MENU_TOOL_BFBCODE_XM,
     MENU_TOOL_SRAMCODE_XM,
     MENU_TOOL_WSMONITOR,
@@ -39,14 +52,20 @@ typedef enum {
 } ui_tool_id_t;
 
 static uint16_t __far ui_tool_lks[] = {
+    LK_UI_TOOLS_INSTALL_XM,
+    LK_UI_TOOLS_DELTA_XM,
+    LK_UI_TOOLS_DUMP_ROM_XM,
+    LK_UI_TOOLS_DUMP_SAVE_XM,
+    LK_UI_TOOLS_IMPORT_SAVE_XM,
+    LK_UI_TOOLS_REMOTE,
     LK_UI_TOOLS_BFBCODE_XM,
     LK_UI_TOOLS_SRAMCODE_XM,
     LK_UI_TOOLS_WSMONITOR,
     LK_UI_TOOLS_WSMONITOR_RAM,
     LK_UI_TOOLS_IPL_SRAM
 };
-static void ui_tool_menu_build_line(uint8_t entry_id, void *userdata, char *buf, int buf_len, char *buf_right, int buf_right_len) {
-    strncpy(buf, lang_keys[ui_tool_lks[entry_id]], buf_len);
+static void ui_tool_menu_build_line(uint16_t entry_id, void *userdata, char *buf, int buf_len, char *buf_right, int buf_right_len) {
+    strncpy(buf, lang_get(ui_tool_lks[entry_id]), buf_len);
     if (entry_id >= MENU_TOOL_IPL_SRAM) {
         buf_right[0] = '>';
         buf_right[1] = '>';
@@ -55,30 +74,94 @@ static void ui_tool_menu_build_line(uint8_t entry_id, void *userdata, char *buf,
 }
 
 static void ui_tool_xmodem_ui_message(uint16_t lk_msg) {
-    ui_fill_line(13, 0);
-    ui_puts_centered(false, 13, 0, lang_keys[lk_msg]);
+    ui_queue_puts_centered(13, 0, lang_get(lk_msg));
 }
 
 static void ui_tool_xmodem_ui_step(uint32_t bytes) {
-    uint8_t line = inportb(IO_LCD_LINE);
-    if (line >= 136 || line < 72) {
-        ui_fill_line(14, 0);
-        ui_bg_printf_centered(14, 0, lang_keys[LK_UI_XMODEM_BYTE_PROGRESS], bytes);
-    }
+    ui_queue_printf_centered(14, 0, lang_get(LK_UI_XMODEM_BYTE_PROGRESS), bytes);
     ui_step_work_indicator();
 }
 
+typedef struct {
+    uint8_t __far* dest;
+    uint16_t max;
+} ui_tool_unpack_mem_t;
+
+static uint8_t __far* ui_tool_unpack_mem_map(void *userdata, uint32_t offset, uint16_t len) {
+    ui_tool_unpack_mem_t *mem = userdata;
+    if (offset + len > mem->max) {
+        return NULL;
+    }
+    ui_tool_xmodem_ui_step(offset + len);
+    return mem->dest + (uint16_t) offset;
+}
+
+// Receive a compressed file (see unpack.h), whose first block is in
+// xmodem_block_buffer, and unpack it to memory at dest.
+static uint8_t ui_tool_xmodem_recv_unpack(uint8_t __far* dest, uint16_t max, uint16_t *size) {
+    uint8_t *buffer = xmodem_block_buffer;
+    uint16_t block_size = xmodem_recv_block_size();
+    uint8_t result = XMODEM_OK;
+    ui_tool_unpack_mem_t mem = {
+        .dest = dest,
+        .max = max
+    };
+    unpack_t unpack;
+    unpack_init(&unpack, UNPACK_FILL_GAPS, ui_tool_unpack_mem_map, NULL, &mem);
+
+    while (result == XMODEM_OK) {
+        if (!unpack_feed(&unpack, buffer, block_size)) {
+            result = XMODEM_ERROR;
+            break;
+        }
+        xmodem_recv_ack();
+        result = xmodem_recv_block(buffer);
+        block_size = xmodem_recv_block_size();
+    }
+    if (result == XMODEM_COMPLETE && !unpack_finish(&unpack)) {
+        result = XMODEM_ERROR;
+    }
+    *size = unpack.size;
+    return result;
+}
+
+// Compressed files are unpacked here in full, before the load address is
+// known, then moved into place; valid load addresses are never below it.
+#define BFB_UNPACK_PTR MK_FP(0x0000, 0x6800)
+#define BFB_CODE_END 0xFE00
+
+// returns the number of bytes available for the code, or 0 if the header
+// is invalid
+static uint16_t ui_tool_bfb_parse_header(const uint8_t __far* header, uint8_t __far** code_start_ptr) {
+    if (header[0] != 'b' || header[1] != 'F') {
+        return 0;
+    }
+    uint16_t code_start = *((uint16_t __far*) (header + 2));
+    if (code_start == 0xFFFF) {
+        code_start = 0x6800;
+        *code_start_ptr = MK_FP(0x0680, 0x0000);
+    } else {
+        *code_start_ptr = MK_FP(0x0000, code_start);
+    }
+    if (code_start < 0x6800 || code_start > (BFB_CODE_END - 128)) {
+        return 0;
+    }
+    return BFB_CODE_END - code_start;
+}
+
+// Blocks are received into xmodem_block_buffer, then copied into place; the
+// last one may hold padding past the end of the available memory.
 static void ui_tool_sramcode_bfb() {
-    uint8_t buffer[128];
+    uint8_t *buffer = xmodem_block_buffer;
 
     ui_reset_main_screen();
-    ui_puts_centered(false, 2, 0, lang_keys[LK_UI_XMODEM_RECEIVE]);
-    ui_puts_centered(false, 3, 0, lang_keys[LK_UI_XMODEM_PRESS_B_TO_CANCEL]);
+    ui_puts_centered(false, 2, 0, lang_get(LK_UI_XMODEM_RECEIVE));
+    ui_puts_centered(false, 3, 0, lang_get(LK_UI_XMODEM_PRESS_B_TO_CANCEL));
 
     uint8_t __far* code_start_ptr;
-    uint8_t __far* code_ptr = buffer;
-    uint16_t code_blocks_left = 0xFFFF;
-    bool code_offset0 = false;
+    uint8_t __far* code_ptr;
+    uint16_t code_bytes_left = 0;
+    bool code_header = true;
     bool active = true;
 
     xmodem_open_default();
@@ -86,7 +169,22 @@ static void ui_tool_sramcode_bfb() {
         ui_tool_xmodem_ui_message(LK_UI_XMODEM_IN_PROGRESS);
 
         while (active) {
-            uint8_t result = xmodem_recv_block(code_ptr);
+            uint8_t result = xmodem_recv_block(buffer);
+            uint16_t block_size = xmodem_recv_block_size();
+            if (result == XMODEM_OK && code_header && unpack_is_header(buffer)) {
+                uint8_t __far* unpacked = BFB_UNPACK_PTR;
+                uint16_t size;
+                result = ui_tool_xmodem_recv_unpack(unpacked, BFB_CODE_END - 0x6800, &size);
+                if (result == XMODEM_COMPLETE) {
+                    code_bytes_left = size >= 4 ? ui_tool_bfb_parse_header(unpacked, &code_start_ptr) : 0;
+                    if (code_bytes_left == 0 || code_bytes_left < size - 4) {
+                        ui_tool_xmodem_ui_message(LK_UI_XMODEM_INVALID_FILE);
+                        active = false;
+                        continue;
+                    }
+                    memmove(code_start_ptr, unpacked + 4, size - 4);
+                }
+            }
             switch (result) {
                 case XMODEM_COMPLETE:
                     launch_ram(code_start_ptr);
@@ -95,40 +193,32 @@ static void ui_tool_sramcode_bfb() {
                 case XMODEM_CANCEL:
                     active = false;
                     break;
-                case XMODEM_OK:
-                    if (code_blocks_left == 0xFFFF) {
-                        if (buffer[0] != 'b' || buffer[1] != 'F') {
+                case XMODEM_OK: {
+                    const uint8_t *data = buffer;
+                    if (code_header) {
+                        code_bytes_left = ui_tool_bfb_parse_header(buffer, &code_start_ptr);
+                        if (code_bytes_left == 0) {
                             ui_tool_xmodem_ui_message(LK_UI_XMODEM_INVALID_FILE);
                             active = false;
                             break;
-                        } else {
-                            uint16_t code_start = *((uint16_t *) (buffer + 2));
-                            if (code_start == 0xFFFF) {
-                                code_start = 0x6800;
-                                code_start_ptr = MK_FP(0x0680, 0x0000);
-                                code_offset0 = true;
-                            } else {
-                                code_start_ptr = MK_FP(0x0000, code_start);
-                            }
-                            if (code_start < 0x6800 || code_start > 0xFD80) {
-                                ui_tool_xmodem_ui_message(LK_UI_XMODEM_INVALID_FILE);
-                                active = false;
-                                break;
-                            } else {
-                                code_blocks_left = (0xFE00 - code_start - 124) >> 7;
-                                code_ptr = code_start_ptr;
-                                memcpy(code_ptr, buffer + 4, 124);
-                                code_ptr += 124;
-                                xmodem_recv_ack();
-                                break;
-                            }
                         }
-                    } else if (code_blocks_left--) {
-                        code_ptr += 128;
+                        code_header = false;
+                        code_ptr = code_start_ptr;
+                        data += 4;
+                        block_size -= 4;
+                    }
+                    if (code_bytes_left != 0) {
+                        // whatever does not fit is padding
+                        if (block_size > code_bytes_left) {
+                            block_size = code_bytes_left;
+                        }
+                        memcpy(code_ptr, data, block_size);
+                        code_bytes_left -= block_size;
+                        code_ptr += block_size;
                         xmodem_recv_ack();
                         break;
                     }
-                    // fall through to XMODEM_ERROR
+                } // fall through to XMODEM_ERROR
                 case XMODEM_ERROR:
                     ui_tool_xmodem_ui_message(LK_UI_XMODEM_ERROR);
                     active = false;
@@ -146,11 +236,11 @@ static void ui_tool_sramcode_xm() {
     sram_switch_to_slot(0xFF);
 
     ui_reset_main_screen();
-    ui_puts_centered(false, 2, 0, lang_keys[LK_UI_XMODEM_RECEIVE]);
-    ui_puts_centered(false, 3, 0, lang_keys[LK_UI_XMODEM_PRESS_B_TO_CANCEL]);
+    ui_puts_centered(false, 2, 0, lang_get(LK_UI_XMODEM_RECEIVE));
+    ui_puts_centered(false, 3, 0, lang_get(LK_UI_XMODEM_PRESS_B_TO_CANCEL));
 
     uint8_t __far* sram_ptr = MK_FP(0x1000, 0x0010);
-    uint16_t sram_incrs = 0;
+    uint32_t sram_bytes = 0;
     bool active = true;
 
     xmodem_open_default();
@@ -158,7 +248,14 @@ static void ui_tool_sramcode_xm() {
         ui_tool_xmodem_ui_message(LK_UI_XMODEM_IN_PROGRESS);
 
         while (active) {
-            uint8_t result = xmodem_recv_block(sram_ptr);
+            uint8_t result = xmodem_recv_block(xmodem_block_buffer);
+            uint16_t block_size = xmodem_recv_block_size();
+            if (result == XMODEM_OK && sram_bytes == 0 && unpack_is_header(xmodem_block_buffer)) {
+                uint16_t size;
+                // the same address, normalized so that the end of the
+                // code is not at offset 0x10000
+                result = ui_tool_xmodem_recv_unpack(MK_FP(0x1001, 0x0000), 0xFFF0, &size);
+            }
             switch (result) {
                 case XMODEM_COMPLETE:
                     launch_ram(MK_FP(0x1000, 0x0010));
@@ -168,10 +265,16 @@ static void ui_tool_sramcode_xm() {
                     active = false;
                     break;
                 case XMODEM_OK:
-                    sram_incrs++;
-                    if (sram_incrs < 512) {
-                        ui_tool_xmodem_ui_step((uint32_t) sram_incrs << 7);
-                        sram_ptr += 128;
+                    if (sram_bytes < 0xFFF0) {
+                        // whatever does not fit is padding; the copy must
+                        // not wrap around to the start of the segment
+                        if (block_size > 0xFFF0 - sram_bytes) {
+                            block_size = 0xFFF0 - sram_bytes;
+                        }
+                        memcpy(sram_ptr, xmodem_block_buffer, block_size);
+                        sram_bytes += block_size;
+                        ui_tool_xmodem_ui_step(sram_bytes);
+                        sram_ptr += block_size;
                         xmodem_recv_ack();
                         break;
                     }
@@ -189,9 +292,477 @@ static void ui_tool_sramcode_xm() {
     while (!xmodem_poll_exit()) cpu_halt();
 }
 
-void ui_tools(void) {
-    uint8_t menu_list[16];
+#ifdef USE_SLOT_SYSTEM
+// Multilinear slots are split into sub-slots of 1MB (16 banks) each.
+#define INSTALL_SUB_SLOT_BANKS 16
+#define INSTALL_SUB_SLOTS 8
+#define INSTALL_BANK_MIN 0x80
+
+static ui_pbar_state_t *ui_tool_install_pbar;
+
+static void ui_tool_install_step(uint32_t bytes) {
+    if (ui_tool_install_pbar != NULL) {
+        ui_tool_install_pbar->step = bytes >> 10;
+    }
+    ui_tool_xmodem_ui_step(bytes);
+}
+
+static void ui_tool_install_slot_build_line(uint16_t entry_id, void *userdata, char *buf, int buf_len, char *buf_right, int buf_right_len) {
+    format_snprintf(buf, buf_len, lang_get(LK_UI_SLOTMAP_SLOT), entry_id + 1);
+    if (settings_local.slot_type[entry_id] == SLOT_TYPE_MULTILINEAR_SOFT) {
+        strncpy(buf_right, lang_get(LK_UI_SLOTMAP_MULTILINEAR_SOFT), buf_right_len);
+    } else if (settings_local.slot_type[entry_id] == SLOT_TYPE_UNUSED) {
+        strncpy(buf_right, lang_get(LK_UI_SLOTMAP_UNUSED), buf_right_len);
+    } else {
+        strncpy(buf_right, lang_get(LK_UI_SLOTMAP_SOFT), buf_right_len);
+    }
+}
+
+static void ui_tool_install_sub_slot_build_line(uint8_t entry_id, void *userdata, char *buf, int buf_len) {
+    format_snprintf(buf, buf_len, lang_get(LK_UI_INSTALL_SUB_SLOT), entry_id + 1);
+}
+
+static void ui_tool_install_size_build_line(uint8_t entry_id, void *userdata, char *buf, int buf_len) {
+    format_snprintf(buf, buf_len, lang_get(LK_UI_BROWSE_INFO_ROM_SIZE_MBIT), rom_size_table[entry_id]);
+}
+
+static uint16_t ui_tool_install_rom_banks(uint8_t rom_size) {
+    return ((uint16_t) rom_size_table[rom_size]) * 2;
+}
+
+// the lowest bank taken up by an installed ROM
+static uint16_t ui_tool_install_entry_bottom(const catalog_entry_t *entry) {
+    uint16_t banks = INSTALL_SUB_SLOT_BANKS;
+    if (entry->rom_size < ROM_SIZE_TABLE_LEN && ui_tool_install_rom_banks(entry->rom_size) > banks) {
+        banks = ui_tool_install_rom_banks(entry->rom_size);
+    }
+    return catalog_entry_bank(entry->id) + 1 - banks;
+}
+
+// Multilinear sub-slots are found by walking down from the top of the slot,
+// so only occupied sub-slots and the first free one can be installed into.
+static uint8_t ui_tool_install_first_free_sub_slot(uint8_t slot) {
+    const catalog_t *catalog = &settings_local.catalog;
+    uint16_t bank_free = 0x100;
+    for (uint8_t i = 0; i < catalog->count; i++) {
+        const catalog_entry_t *entry = catalog->entries + i;
+        if (catalog_entry_slot(entry->id) != slot) continue;
+        uint16_t bank_bottom = ui_tool_install_entry_bottom(entry);
+        if (bank_bottom < bank_free) bank_free = bank_bottom;
+    }
+    return (0x100 - bank_free + INSTALL_SUB_SLOT_BANKS - 1) / INSTALL_SUB_SLOT_BANKS;
+}
+
+// A sub-slot inside a larger ROM installed above it is not free, even
+// though no ROM starts there.
+static bool ui_tool_install_sub_slot_covered(uint8_t id) {
+    const catalog_t *catalog = &settings_local.catalog;
+    uint8_t bank = catalog_entry_bank(id);
+    for (uint8_t i = 0; i < catalog->count; i++) {
+        const catalog_entry_t *entry = catalog->entries + i;
+        if (catalog_entry_slot(entry->id) != catalog_entry_slot(id)) continue;
+        if (catalog_entry_bank(entry->id) > bank && ui_tool_install_entry_bottom(entry) <= bank) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// the lowest bank a ROM installed at id may take up, above the next ROM
+// below it in the same slot
+static uint16_t ui_tool_install_bank_floor(uint8_t id) {
+    const catalog_t *catalog = &settings_local.catalog;
+    uint8_t bank = catalog_entry_bank(id);
+    uint16_t floor = INSTALL_BANK_MIN;
+    for (uint8_t i = 0; i < catalog->count; i++) {
+        const catalog_entry_t *entry = catalog->entries + i;
+        if (catalog_entry_slot(entry->id) != catalog_entry_slot(id)) continue;
+        uint8_t entry_bank = catalog_entry_bank(entry->id);
+        if (entry_bank < bank && entry_bank >= floor) {
+            floor = entry_bank + 1;
+        }
+    }
+    return floor;
+}
+
+// returns a catalog entry ID, or 0xFF if cancelled
+static uint8_t ui_tool_install_select_target(void) {
+    uint8_t menu_list[GAME_SLOTS + 1];
+    uint8_t sub_list[INSTALL_SUB_SLOTS + 1];
+    ui_menu_state_t menu;
     uint8_t i = 0;
+
+    for (uint8_t slot = 0; slot < GAME_SLOTS; slot++) {
+        if (settings_local.slot_type[slot] == SLOT_TYPE_LAUNCHER || slot == driver_get_launch_slot()) continue;
+        menu_list[i++] = slot;
+    }
+    menu_list[i] = MENU_ENTRY_END;
+
+    _nmemset(&menu, 0, sizeof(ui_menu_state_t));
+    menu.list = menu_list;
+    menu.build_line_func = ui_tool_install_slot_build_line;
+    menu.flags = MENU_B_AS_BACK;
+    ui_menu_init(&menu);
+    ui_reset_main_screen();
+
+    uint16_t result = ui_menu_select(&menu);
+    if (result == MENU_ENTRY_END) {
+        return 0xFF;
+    }
+    uint8_t slot = result & 0xFF;
+    if (settings_local.slot_type[slot] != SLOT_TYPE_MULTILINEAR_SOFT) {
+        return slot;
+    }
+
+    catalog_refresh();
+    uint8_t sub_slots = ui_tool_install_first_free_sub_slot(slot);
+    i = 0;
+    for (uint8_t k = 0; k <= sub_slots && k < INSTALL_SUB_SLOTS; k++) {
+        if (!ui_tool_install_sub_slot_covered(slot | (k << 4))) {
+            sub_list[i++] = k;
+        }
+    }
+    sub_list[i] = MENU_ENTRY_END;
+
+    ui_popup_menu_state_t popup_menu = {
+        .list = sub_list,
+        .build_line_func = ui_tool_install_sub_slot_build_line,
+        .flags = 0
+    };
+    result = ui_popup_menu_run(&popup_menu);
+    if (result == MENU_ENTRY_END) {
+        return 0xFF;
+    }
+    return slot | (result << 4);
+}
+
+// returns an index into rom_size_table, or 0xFF if cancelled
+static uint8_t ui_tool_install_select_size(uint8_t id) {
+    uint8_t size_list[ROM_SIZE_TABLE_LEN + 1];
+    uint16_t banks_max = catalog_entry_bank(id) + 1 - ui_tool_install_bank_floor(id);
+    uint8_t i = 0;
+
+    for (uint8_t k = 0; k < ROM_SIZE_TABLE_LEN; k++) {
+        if (ui_tool_install_rom_banks(k) <= banks_max) {
+            size_list[i++] = k;
+        }
+    }
+    size_list[i] = MENU_ENTRY_END;
+
+    ui_popup_menu_state_t popup_menu = {
+        .list = size_list,
+        .build_line_func = ui_tool_install_size_build_line,
+        .flags = 0
+    };
+    uint16_t result = ui_popup_menu_run(&popup_menu);
+    return result == MENU_ENTRY_END ? 0xFF : result;
+}
+
+// Check the installed ROM against its header, and add it to the catalog.
+static uint16_t ui_tool_install_verify(uint8_t id, uint8_t rom_size) {
+    uint8_t rom_header[16];
+
+    _nmemset(rom_header, 0xFF, sizeof(rom_header));
+    driver_unlock();
+    catalog_read_rom_header(rom_header, id);
+    driver_lock();
+    if (!catalog_is_valid_rom_header(rom_header) || rom_header[10] >= ROM_SIZE_TABLE_LEN
+        || ui_tool_install_rom_banks(rom_header[10]) != ui_tool_install_rom_banks(rom_size)) {
+        return LK_UI_XMODEM_INVALID_FILE;
+    }
+
+    catalog_refresh();
+    const catalog_t *catalog = &settings_local.catalog;
+    for (uint8_t i = 0; i < catalog->count; i++) {
+        if (catalog->entries[i].id == id) {
+            return catalog_verify_entry(i) ? LK_UI_XMODEM_COMPLETE : LK_UI_INSTALL_CHECKSUM_BAD;
+        }
+    }
+    return LK_UI_XMODEM_INVALID_FILE;
+}
+
+// If the last transfer to the same banks was interrupted, ask whether the
+// host may resume it; otherwise, it starts over.
+static void ui_tool_offer_resume(const xmodem_flash_t *states, uint8_t count) {
+    if (xmodem_flash_recv_resumable(states, count)
+        && ui_dialog_run(0, 0, LK_DIALOG_RESUME_TRANSFER, LK_DIALOG_YES_NO) != 0) {
+        xmodem_flash_recv_discard();
+    }
+}
+
+// With delta set, only the blocks which differ from the slot's current
+// contents are transferred (see xmodem_flash_delta).
+static void ui_tool_install_xm(bool delta) {
+    uint8_t id = ui_tool_install_select_target();
+    if (id == 0xFF) return;
+    uint8_t rom_size = ui_tool_install_select_size(id);
+    if (rom_size == 0xFF) return;
+    if (ui_dialog_run(0, 1, LK_DIALOG_CONFIRM, LK_DIALOG_YES_NO) != 0) return;
+
+    uint8_t slot = catalog_entry_slot(id);
+    uint16_t banks = ui_tool_install_rom_banks(rom_size);
+
+    xmodem_flash_t state = {
+        .slot = slot,
+        .bank = catalog_entry_bank(id) + 1 - banks,
+        .bank_count = banks,
+        .progress = ui_tool_install_step
+    };
+    // SRAM is used as scratch space by delta updates and compressed files.
+    // Flushing an active save block discards the checkpoint, so do it
+    // before offering to resume, not after.
+    sram_switch_to_slot(0xFF);
+    if (!delta) {
+        ui_tool_offer_resume(&state, 1);
+    }
+
+    ui_reset_main_screen();
+    ui_puts_centered(false, 2, 0, lang_get(LK_UI_XMODEM_RECEIVE));
+    ui_puts_centered(false, 3, 0, lang_get(LK_UI_XMODEM_PRESS_B_TO_CANCEL));
+
+    ui_pbar_state_t pbar = {
+        .x = 0,
+        .y = 11,
+        .width = 27,
+        .step_max = banks << 6
+    };
+    ui_pbar_init(&pbar);
+    ui_tool_install_pbar = NULL;
+    if (!delta) {
+        // the size of a patch is not known in advance
+        ui_pbar_show(&pbar);
+        ui_tool_install_pbar = &pbar;
+    }
+
+    // the slot's previous contents are gone as soon as it is erased
+    if (settings_local.slot_type[slot] != SLOT_TYPE_MULTILINEAR_SOFT) {
+        settings_local.slot_type[slot] = SLOT_TYPE_SOFT;
+        if (!delta) {
+            settings_local.slot_name[slot][0] = 0;
+        }
+    }
+    catalog_mark_slot_changed();
+
+    xmodem_open_default_buffered();
+    ui_tool_xmodem_ui_message(LK_UI_XMODEM_IN_PROGRESS);
+    uint8_t result = delta ? xmodem_flash_delta(&state) : xmodem_flash_recv(&state, 1);
+    xmodem_close();
+
+    if (!delta) {
+        ui_pbar_hide(&pbar);
+    }
+    ui_clear_work_indicator();
+
+    if (result == XMODEM_COMPLETE) {
+        if (!delta && state.offset != ((uint32_t) banks << 16)) {
+            ui_tool_xmodem_ui_message(LK_UI_XMODEM_INVALID_FILE);
+        } else {
+            ui_tool_xmodem_ui_message(ui_tool_install_verify(id, rom_size));
+        }
+    } else if (result == XMODEM_ERROR) {
+        ui_tool_xmodem_ui_message(LK_UI_XMODEM_ERROR);
+    } else {
+        ui_tool_xmodem_ui_message(LK_UI_XMODEM_CANCEL);
+    }
+
+    while (!xmodem_poll_exit()) cpu_halt();
+}
+
+// Send or receive banks of flash, one state per contiguous run, as one file.
+static void ui_tool_transfer_xm(xmodem_flash_t *states, uint8_t count, bool receive) {
+    uint16_t banks = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        banks += states[i].bank_count;
+    }
+
+    ui_reset_main_screen();
+    ui_puts_centered(false, 2, 0, lang_get(receive ? LK_UI_XMODEM_RECEIVE : LK_UI_XMODEM_SEND));
+    ui_puts_centered(false, 3, 0, lang_get(LK_UI_XMODEM_PRESS_B_TO_CANCEL));
+
+    ui_pbar_state_t pbar = {
+        .x = 0,
+        .y = 11,
+        .width = 27,
+        .step_max = banks << 6
+    };
+    ui_pbar_init(&pbar);
+    ui_pbar_show(&pbar);
+    ui_tool_install_pbar = &pbar;
+
+    for (uint8_t i = 0; i < count; i++) {
+        states[i].progress = ui_tool_install_step;
+    }
+    xmodem_open_default_buffered();
+    ui_tool_xmodem_ui_message(LK_UI_XMODEM_IN_PROGRESS);
+    uint8_t result = receive ? xmodem_flash_recv(states, count) : xmodem_flash_send(states, count);
+    xmodem_close();
+
+    ui_pbar_hide(&pbar);
+    ui_clear_work_indicator();
+
+    if (result == (receive ? XMODEM_COMPLETE : XMODEM_OK)) {
+        ui_tool_xmodem_ui_message(LK_UI_XMODEM_COMPLETE);
+    } else if (result == XMODEM_ERROR) {
+        ui_tool_xmodem_ui_message(LK_UI_XMODEM_ERROR);
+    } else {
+        ui_tool_xmodem_ui_message(LK_UI_XMODEM_CANCEL);
+    }
+
+    while (!xmodem_poll_exit()) cpu_halt();
+}
+
+static void ui_tool_dump_rom_xm(void) {
+    uint8_t rom_header[16];
+    uint8_t id = ui_tool_install_select_target();
+    if (id == 0xFF) return;
+    uint16_t banks_max = catalog_entry_bank(id) + 1 - ui_tool_install_bank_floor(id);
+
+    // take the size from the ROM header, if there is a plausible one
+    _nmemset(rom_header, 0xFF, sizeof(rom_header));
+    driver_unlock();
+    catalog_read_rom_header(rom_header, id);
+    driver_lock();
+    uint8_t rom_size = rom_header[10];
+    if (!catalog_is_valid_rom_header(rom_header) || rom_size >= ROM_SIZE_TABLE_LEN
+        || ui_tool_install_rom_banks(rom_size) > banks_max) {
+        rom_size = ui_tool_install_select_size(id);
+        if (rom_size == 0xFF) return;
+    }
+
+    uint16_t banks = ui_tool_install_rom_banks(rom_size);
+    xmodem_flash_t state = {
+        .slot = catalog_entry_slot(id),
+        .bank = catalog_entry_bank(id) + 1 - banks,
+        .bank_count = banks
+    };
+    // SRAM holds the blocks being sent
+    sram_switch_to_slot(0xFF);
+    ui_tool_transfer_xm(&state, 1, false);
+}
+
+static void ui_tool_dump_save_block_build_line(uint8_t entry_id, void *userdata, char *buf, int buf_len) {
+    format_snprintf(buf, buf_len, lang_get(LK_UI_BROWSE_USE_SRAM), entry_id + 'A');
+}
+
+static void ui_tool_dump_save_size_build_line(uint8_t entry_id, void *userdata, char *buf, int buf_len) {
+    format_snprintf(buf, buf_len, lang_get(LK_UI_DUMP_SAVE_SIZE), 64 << entry_id);
+}
+
+// Save blocks are stored in 64 KB flash banks; see sram_get_bank().
+#define DUMP_SAVE_BANKS 8
+
+// returns a save block, or 0xFF if cancelled
+static uint8_t ui_tool_save_select_block(void) {
+    uint8_t menu_list[SRAM_SLOTS + 1];
+
+    for (uint8_t i = 0; i < SRAM_SLOTS; i++) {
+        menu_list[i] = i;
+    }
+    menu_list[SRAM_SLOTS] = MENU_ENTRY_END;
+    ui_popup_menu_state_t popup_menu = {
+        .list = menu_list,
+        .build_line_func = ui_tool_dump_save_block_build_line,
+        .flags = 0
+    };
+    uint16_t result = ui_popup_menu_run(&popup_menu);
+    return result == MENU_ENTRY_END ? 0xFF : result;
+}
+
+// A save block may be split around the settings area; merge its first
+// banks banks into contiguous runs. Returns the number of runs.
+static uint8_t ui_tool_save_bank_runs(xmodem_flash_t *states, uint8_t sram_slot, uint8_t banks) {
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < banks; i++) {
+        uint8_t bank = sram_get_bank(sram_slot, i);
+        if (count > 0 && states[count - 1].bank + states[count - 1].bank_count == bank) {
+            states[count - 1].bank_count++;
+        } else {
+            states[count].slot = driver_get_launch_slot();
+            states[count].bank = bank;
+            states[count].bank_count = 1;
+            count++;
+        }
+    }
+    return count;
+}
+
+static void ui_tool_dump_save_xm(void) {
+    uint8_t size_list[5];
+    xmodem_flash_t states[DUMP_SAVE_BANKS];
+
+    uint8_t sram_slot = ui_tool_save_select_block();
+    if (sram_slot == 0xFF) return;
+
+    // 64, 128, 256 or 512 KB
+    for (uint8_t i = 0; i < 4; i++) {
+        size_list[i] = i;
+    }
+    size_list[4] = MENU_ENTRY_END;
+    ui_popup_menu_state_t popup_menu = {
+        .list = size_list,
+        .build_line_func = ui_tool_dump_save_size_build_line,
+        .flags = 0
+    };
+    uint16_t size = ui_popup_menu_run(&popup_menu);
+    if (size == MENU_ENTRY_END) return;
+
+    // the active save block may have unsaved changes in SRAM
+    sram_switch_to_slot(0xFF);
+
+    uint8_t count = ui_tool_save_bank_runs(states, sram_slot, 1 << size);
+    ui_tool_transfer_xm(states, count, false);
+}
+
+// The file replaces the whole save block; whatever it does not cover is
+// left erased.
+static void ui_tool_import_save_xm(void) {
+    xmodem_flash_t states[DUMP_SAVE_BANKS];
+
+    uint8_t sram_slot = ui_tool_save_select_block();
+    if (sram_slot == 0xFF) return;
+    if (ui_dialog_run(0, 1, LK_DIALOG_CONFIRM, LK_DIALOG_YES_NO) != 0) return;
+
+    // otherwise, the active save block's SRAM contents would later be
+    // written back over the imported data
+    sram_switch_to_slot(0xFF);
+
+    uint8_t count = ui_tool_save_bank_runs(states, sram_slot, DUMP_SAVE_BANKS);
+    ui_tool_offer_resume(states, count);
+    ui_tool_transfer_xm(states, count, true);
+}
+
+static void ui_tool_remote(void) {
+    ui_reset_main_screen();
+    ui_puts_centered(false, 2, 0, lang_get(LK_UI_TOOLS_REMOTE));
+    ui_puts_centered(false, 3, 0, lang_get(LK_UI_XMODEM_PRESS_B_TO_CANCEL));
+
+    xmodem_open_default_buffered();
+    ui_tool_xmodem_ui_message(LK_UI_REMOTE_READY);
+    uint8_t id = remote_run();
+    xmodem_close();
+    ui_clear_work_indicator();
+
+    if (id != REMOTE_NO_LAUNCH) {
+        uint8_t rom_header[16];
+        _nmemset(rom_header, 0xFF, sizeof(rom_header));
+        driver_unlock();
+        catalog_read_rom_header(rom_header, id);
+        driver_lock();
+        ui_browse_launch(id, rom_header);
+    }
+}
+#endif
+
+static void ui_tools_menu_init(ui_menu_state_t *menu, uint8_t *menu_list) {
+    uint8_t i = 0;
+#ifdef USE_SLOT_SYSTEM
+    menu_list[i++] = MENU_TOOL_INSTALL_XM;
+    menu_list[i++] = MENU_TOOL_DELTA_XM;
+    menu_list[i++] = MENU_TOOL_DUMP_ROM_XM;
+    menu_list[i++] = MENU_TOOL_DUMP_SAVE_XM;
+    menu_list[i++] = MENU_TOOL_IMPORT_SAVE_XM;
+    menu_list[i++] = MENU_TOOL_REMOTE;
+#endif
     if (ws_system_color_active()) menu_list[i++] = MENU_TOOL_BFBCODE_XM;
     if ((_CS & 0xF000) != 0x1000) menu_list[i++] = MENU_TOOL_SRAMCODE_XM;
     menu_list[i++] = MENU_TOOL_WSMONITOR;
@@ -201,15 +772,35 @@ void ui_tools(void) {
 #endif
     menu_list[i++] = MENU_ENTRY_END;
 
-    ui_menu_state_t menu = {
-        .list = menu_list,
-        .build_line_func = ui_tool_menu_build_line,
-        .flags = 0
-    };
-    ui_menu_init(&menu);
+    _nmemset(menu, 0, sizeof(ui_menu_state_t));
+    menu->list = menu_list;
+    menu->build_line_func = ui_tool_menu_build_line;
+    ui_menu_init(menu);
+}
+
+bool ui_tools_prerender(void) {
+    uint8_t menu_list[16];
+    ui_menu_state_t menu;
+    ui_tools_menu_init(&menu, menu_list);
+    ui_menu_draw(&menu);
+    return true;
+}
+
+void ui_tools(void) {
+    uint8_t menu_list[16];
+    ui_menu_state_t menu;
+    ui_tools_menu_init(&menu, menu_list);
 
     uint16_t result = ui_menu_select(&menu);
     switch (result) {
+#ifdef USE_SLOT_SYSTEM
+        case MENU_TOOL_INSTALL_XM: ui_tool_install_xm(false); break;
+        case MENU_TOOL_DELTA_XM: ui_tool_install_xm(true); break;
+        case MENU_TOOL_DUMP_ROM_XM: ui_tool_dump_rom_xm(); break;
+        case MENU_TOOL_DUMP_SAVE_XM: ui_tool_dump_save_xm(); break;
+        case MENU_TOOL_IMPORT_SAVE_XM: ui_tool_import_save_xm(); break;
+        case MENU_TOOL_REMOTE: ui_tool_remote(); break;
+#endif
         case MENU_TOOL_BFBCODE_XM: ui_tool_sramcode_bfb(); break;
         case MENU_TOOL_SRAMCODE_XM: ui_tool_sramcode_xm(); break;
         case MENU_TOOL_WSMONITOR: launch_ram(_wsmonitor_bin); break;
@@ -0,0 +1,161 @@
+/**
+ * Copyright (c) 2023 Adrian Siekierka
+ *
+ * CartFriend is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * CartFriend is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with CartFriend. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <ws.h>
+#include "unpack.h"
+
+// Header record: "CFZ", version, decoded size (LE32), record count (LE16).
+// Data record: offset (LE32), decoded length (LE16), LZSS stream length
+// (LE16), LZSS stream.
+#define UNPACK_VERSION 1
+#define UNPACK_RECORD_HEADER_SIZE 8
+
+static inline uint16_t unpack_get16(const uint8_t __far* data) {
+    return data[0] | (data[1] << 8);
+}
+
+static inline uint32_t unpack_get32(const uint8_t __far* data) {
+    return unpack_get16(data) | ((uint32_t) unpack_get16(data + 2) << 16);
+}
+
+bool unpack_is_header(const uint8_t __far* data) {
+    return data[0] == 'C' && data[1] == 'F' && data[2] == 'Z' && data[3] == UNPACK_VERSION;
+}
+
+void unpack_init(unpack_t *unpack, uint8_t flags,
+    uint8_t __far* (*map)(void*, uint32_t, uint16_t),
+    bool (*commit)(void*, uint32_t, const uint8_t __far*, uint16_t),
+    void *userdata) {
+
+    _nmemset(unpack, 0, sizeof(unpack_t));
+    unpack->userdata = userdata;
+    unpack->map = map;
+    unpack->commit = commit;
+    unpack->flags = flags;
+}
+
+static bool unpack_commit(unpack_t *unpack, uint32_t offset, const uint8_t __far* data, uint16_t len) {
+    if (unpack->commit != NULL && !unpack->commit(unpack->userdata, offset, data, len)) {
+        return false;
+    }
+    unpack->end = offset + len;
+    return true;
+}
+
+// UNPACK_FILL_GAPS: store 0xFF bytes from the end of the last chunk up to
+// the given offset.
+static bool unpack_fill(unpack_t *unpack, uint32_t offset) {
+    while (unpack->end < offset) {
+        uint32_t len = 0x10000 - (unpack->end & 0xFFFF);
+        if (len > UNPACK_CHUNK_SIZE) len = UNPACK_CHUNK_SIZE;
+        if (len > offset - unpack->end) len = offset - unpack->end;
+        uint8_t __far* dst = unpack->map(unpack->userdata, unpack->end, len);
+        if (dst == NULL) {
+            return false;
+        }
+        memset(dst, 0xFF, len);
+        if (!unpack_commit(unpack, unpack->end, dst, len)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool unpack_record(unpack_t *unpack, const uint8_t __far* record) {
+    if (unpack->count == 0) {
+        if (!unpack_is_header(record)) {
+            return false;
+        }
+        unpack->size = unpack_get32(record + 4);
+        unpack->count = unpack_get16(record + 8);
+        unpack->done = 1;
+        return unpack->count != 0;
+    }
+    if (unpack->done >= unpack->count) {
+        return true;
+    }
+
+    uint32_t offset = unpack_get32(record);
+    uint16_t len = unpack_get16(record + 4);
+    uint16_t src_len = unpack_get16(record + 6);
+    if (len > UNPACK_CHUNK_SIZE || src_len > UNPACK_RECORD_SIZE - UNPACK_RECORD_HEADER_SIZE
+        || offset < unpack->end || offset > unpack->size || len > unpack->size - offset
+        || (offset & 0xFFFF) + len > 0x10000) {
+        return false;
+    }
+
+    if ((unpack->flags & UNPACK_FILL_GAPS) && !unpack_fill(unpack, offset)) {
+        return false;
+    }
+    uint8_t __far* dst = unpack->map(unpack->userdata, offset, len);
+    if (dst == NULL) {
+        return false;
+    }
+    // matches may refer back to the start of the bank, within the limit
+    uint16_t history = offset & 0xFFFF;
+    if (history > UNPACK_HISTORY_SIZE) history = UNPACK_HISTORY_SIZE;
+    if (len != 0 && !unpack_lzss(record + UNPACK_RECORD_HEADER_SIZE, src_len, dst, len, history)) {
+        return false;
+    }
+    if (!unpack_commit(unpack, offset, dst, len)) {
+        return false;
+    }
+    unpack->done++;
+    return true;
+}
+
+bool unpack_feed(unpack_t *unpack, const uint8_t __far* data, uint16_t len) {
+    while (len > 0) {
+        if (unpack->pos == 0 && len >= UNPACK_RECORD_SIZE) {
+            // the whole record is there; no need to collect it
+            if (!unpack_record(unpack, data)) {
+                return false;
+            }
+            data += UNPACK_RECORD_SIZE;
+            len -= UNPACK_RECORD_SIZE;
+            continue;
+        }
+
+        uint16_t n = UNPACK_RECORD_SIZE - unpack->pos;
+        if (n > len) n = len;
+        memcpy(unpack->record + unpack->pos, data, n);
+        unpack->pos += n;
+        data += n;
+        len -= n;
+        if (unpack->pos == UNPACK_RECORD_SIZE) {
+            unpack->pos = 0;
+            if (!unpack_record(unpack, unpack->record)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool unpack_finish(unpack_t *unpack) {
+    if (unpack->count == 0 || unpack->done < unpack->count) {
+        return false;
+    }
+    if (unpack->flags & UNPACK_FILL_GAPS) {
+        return unpack_fill(unpack, unpack->size);
+    }
+    return true;
+}
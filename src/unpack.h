@@ -0,0 +1,104 @@
+#pragma once
+/**
+ * Copyright (c) 2023 Adrian Siekierka
+ *
+ * CartFriend is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * CartFriend is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with CartFriend. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// CartFriend - compressed payloads
+//
+// Files sent to the cartridge over serial may be compressed with
+// tools/cf_pack.py, which documents the format. A compressed payload is a
+// sequence of 256-byte records: a header, followed by records which each
+// decode to up to UNPACK_CHUNK_SIZE bytes at a given, ascending offset.
+// Every record fits in one transfer block, but may refer back to up to
+// UNPACK_HISTORY_SIZE bytes decoded before it, within the same 64 KB bank;
+// records are therefore processed in order. Runs of 0xFF bytes are left out
+// altogether, as flash is erased to 0xFF already; memory targets are filled
+// in (see UNPACK_FILL_GAPS).
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wonderful.h>
+
+#define UNPACK_RECORD_SIZE 256
+#define UNPACK_CHUNK_SIZE 1024
+#define UNPACK_HISTORY_SIZE 4096
+
+// Write the gaps between chunks, and after the last one, as 0xFF bytes.
+#define UNPACK_FILL_GAPS 0x01
+
+typedef struct {
+	void *userdata;
+	/**
+	 * Return where the len bytes decoded for the given offset are to be
+	 * stored. The data decoded before them, back to the start of their
+	 * 64 KB bank or UNPACK_HISTORY_SIZE bytes, must be right below.
+	 * Chunks never cross a 64 KB boundary.
+	 * @return NULL to abort.
+	 */
+	uint8_t __far* (*map)(void *userdata, uint32_t offset, uint16_t len);
+	/**
+	 * Optional: called once len bytes have been stored where map() asked
+	 * for them. A length of 0 marks the start of a 64 KB bank which is
+	 * otherwise empty.
+	 * @return false to abort.
+	 */
+	bool (*commit)(void *userdata, uint32_t offset, const uint8_t __far* data, uint16_t len);
+
+	uint8_t flags;
+	uint32_t size; // decoded size, once the header has been processed
+	uint16_t count; // number of records, including the header; 0 before it
+	uint16_t done; // number of records processed
+	uint32_t end; // end of the last chunk
+
+	// unpack_feed(): the record being collected
+	uint16_t pos;
+	uint8_t record[UNPACK_RECORD_SIZE];
+} unpack_t;
+
+/**
+ * @return true if data starts with the header of a compressed payload.
+ */
+bool unpack_is_header(const uint8_t __far* data);
+
+void unpack_init(unpack_t *unpack, uint8_t flags,
+    uint8_t __far* (*map)(void*, uint32_t, uint16_t),
+    bool (*commit)(void*, uint32_t, const uint8_t __far*, uint16_t),
+    void *userdata);
+
+/**
+ * @brief Process the next record. Records past the count given by the
+ * header, such as transfer padding, are ignored.
+ * @return false if the record is invalid, or a callback failed.
+ */
+bool unpack_record(unpack_t *unpack, const uint8_t __far* record);
+
+/**
+ * @brief Process the next len bytes of the payload.
+ */
+bool unpack_feed(unpack_t *unpack, const uint8_t __far* data, uint16_t len);
+
+/**
+ * @brief Check that every record has been processed.
+ * @return false if the payload ended early.
+ */
+bool unpack_finish(unpack_t *unpack);
+
+/**
+ * @brief Decode an LZSS stream (see tools/cf_pack.py).
+ * @param history The number of bytes below dst which matches may refer to.
+ * @return true if src decoded to exactly dst_len bytes.
+ */
+bool unpack_lzss(const uint8_t __far* src, uint16_t src_len, uint8_t __far* dst, uint16_t dst_len, uint16_t history);
@@ -0,0 +1,131 @@
+/**
+ * Copyright (c) 2023 Adrian Siekierka
+ *
+ * CartFriend is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * CartFriend is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with CartFriend. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <wonderful.h>
+
+	.arch	i186
+	.code16
+	.intel_syntax noprefix
+
+	// LZSS, as written by tools/cf_pack.py: a flag byte precedes every
+	// eight items, least significant bit first. A set bit is a literal
+	// byte; a clear bit is a match word (LE), holding the distance - 1 in
+	// its low 12 bits and the length - 3 in its high 4 bits.
+
+	// dx:ax = source, cx = source length
+	// stack = destination (far), destination length, history length
+	// returns al = 1 if the source decoded to exactly the destination length
+	.global unpack_lzss
+	.align 2
+unpack_lzss:
+	push	si
+	push	di
+	push	ds
+	push	es
+	push	bp
+	mov	bp, sp
+
+	// configure ds:si = source, dx = source bytes left,
+	// es:di = destination, bx = destination bytes left
+	// (counts, rather than end pointers, as either may end at 64 KB)
+	mov	si, ax
+	mov	ds, dx
+	mov	dx, cx
+	les	di, [bp + 14]
+	mov	bx, [bp + 18]
+	// matches may not start below the history
+	mov	ax, di
+	sub	ax, [bp + 20]
+	mov	word ptr ss:[unpack_lzss_floor], ax
+	// bp = flag bits left, below a marker bit
+	mov	bp, 1
+	cld
+
+	.align 2, 0x90
+unpack_lzss_loop:
+	test	bx, bx
+	jz	unpack_lzss_done
+	cmp	bp, 1
+	jne	unpack_lzss_item
+	test	dx, dx
+	jz	unpack_lzss_error
+	dec	dx
+	lodsb
+	mov	ah, 1
+	mov	bp, ax
+unpack_lzss_item:
+	shr	bp, 1
+	jnc	unpack_lzss_match
+	test	dx, dx
+	jz	unpack_lzss_error
+	dec	dx
+	dec	bx
+	movsb
+	jmp	unpack_lzss_loop
+
+unpack_lzss_match:
+	cmp	dx, 2
+	jb	unpack_lzss_error
+	sub	dx, 2
+	lodsw
+	mov	cx, ax
+	shr	cx, 12
+	add	cx, 3
+	and	ax, 0xFFF
+	inc	ax
+	// the match has to start within the history or the data decoded so
+	// far...
+	push	si
+	mov	si, di
+	sub	si, word ptr ss:[unpack_lzss_floor]
+	cmp	ax, si
+	ja	unpack_lzss_error_pop
+	mov	si, di
+	sub	si, ax
+	// ...and end within the destination
+	cmp	cx, bx
+	ja	unpack_lzss_error_pop
+	sub	bx, cx
+	// copy byte by byte, as the match may overlap its own output
+	push	ds
+	push	es
+	pop	ds
+	rep	movsb
+	pop	ds
+	pop	si
+	jmp	unpack_lzss_loop
+
+unpack_lzss_error_pop:
+	pop	si
+unpack_lzss_error:
+	xor	al, al
+	jmp	unpack_lzss_return
+
+unpack_lzss_done:
+	mov	al, 1
+unpack_lzss_return:
+	pop	bp
+	pop	es
+	pop	ds
+	pop	di
+	pop	si
+	ASM_PLATFORM_RET 0x8
+
+	.section .bss
+	.align 2
+unpack_lzss_floor:
+	.word 0
@@ -19,8 +19,16 @@
 #include "settings.h"
 #include "xmodem.h"
 
+static uint8_t xmodem_default_baudrate(void) {
+    return (settings_local.flags1 & SETT_FLAGS1_SERIAL_9600BPS) ? SERIAL_BAUD_9600 : SERIAL_BAUD_38400;
+}
+
 void xmodem_open_default(void) {
-    xmodem_open((settings_local.flags1 & SETT_FLAGS1_SERIAL_9600BPS) ? SERIAL_BAUD_9600 : SERIAL_BAUD_38400);
+    xmodem_open(xmodem_default_baudrate());
+}
+
+void xmodem_open_default_buffered(void) {
+    xmodem_open_buffered(xmodem_default_baudrate());
 }
 
 // it's an uint16_t but we only want the low byte
@@ -20,6 +20,7 @@
 #include <stdint.h>
 
 void xmodem_open_default(void);
+void xmodem_open_default_buffered(void);
 
 void wait_for_vblank(void);
 
@@ -27,17 +27,49 @@
 #include <stdint.h>
 #include <wonderful.h>
 #include "input.h"
+#include "serial.h"
+#include "stream.h"
 #include "ui.h"
 #include "util.h"
 #include "xmodem.h"
 
 #define SOH 1
+#define STX 2
 #define EOT 4
 #define ACK 6
 #define NAK 21
 #define CAN 24
+#define CRC 'C'
+
+// number of 'C' requests sent before falling back to checksum mode
+#define XMODEM_CRC_REQUESTS 3
 
 static uint8_t xmodem_idx;
+static bool xmodem_crc;
+static uint8_t xmodem_crc_requests;
+static uint16_t xmodem_block_size;
+static bool xmodem_buffered;
+
+uint8_t xmodem_block_buffer[XMODEM_BLOCK_SIZE_1K];
+
+// CRC-16/XMODEM (polynomial 0x1021), four bits at a time
+static const uint16_t __far xmodem_crc_table[16] = {
+	0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+	0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+static inline uint16_t xmodem_crc_update(uint16_t crc, uint8_t v) {
+	crc = (crc << 4) ^ xmodem_crc_table[(crc >> 12) ^ (v >> 4)];
+	crc = (crc << 4) ^ xmodem_crc_table[(crc >> 12) ^ (v & 0x0F)];
+	return crc;
+}
+
+uint16_t xmodem_crc16(uint16_t crc, const uint8_t __far* data, uint16_t len) {
+	for (uint16_t i = 0; i < len; i++) {
+		crc = xmodem_crc_update(crc, data[i]);
+	}
+	return crc;
+}
 
 bool xmodem_poll_exit(void) {
 	input_update();
@@ -47,53 +79,115 @@ bool xmodem_poll_exit(void) {
 void xmodem_open(uint8_t baudrate) {
 	ws_serial_open(baudrate);
 	ws_hwint_set_default_handler_serial_rx();
+	xmodem_buffered = false;
+}
+
+void xmodem_open_buffered(uint8_t baudrate) {
+	ws_serial_open(baudrate);
+	serial_init_buffered();
+	xmodem_buffered = true;
 }
 
 void xmodem_close(void) {
+	if (xmodem_buffered) {
+		serial_close_buffered();
+	}
 	ws_serial_close();
 }
 
-// call after SOH
-static uint8_t xmodem_read_block(uint8_t __far* block) {
-	uint8_t idx = ws_serial_getc();
+static uint8_t xmodem_getc(void) {
+	if (xmodem_buffered) {
+		int16_t r;
+		while ((r = serial_getc_buffered()) < 0) {
+			cpu_halt();
+		}
+		return r;
+	} else {
+		return ws_serial_getc();
+	}
+}
+
+static int16_t xmodem_getc_nonblock(void) {
+	return xmodem_buffered ? serial_getc_buffered() : ws_serial_getc_nonblock();
+}
+
+static void xmodem_putc(uint8_t value) {
+	if (xmodem_buffered) {
+		serial_putc_buffered(value);
+	} else {
+		ws_serial_putc(value);
+	}
+}
+
+// call after SOH/STX
+static uint8_t xmodem_read_block(uint8_t __far* block, uint16_t size) {
+	uint8_t idx = xmodem_getc();
 	if (idx != xmodem_idx) {
 		return XMODEM_CANCEL;
 	}
-	uint8_t idx_inv = ws_serial_getc();
+	uint8_t idx_inv = xmodem_getc();
 	if ((idx ^ 0xFF) != idx_inv) {
 		return XMODEM_CANCEL;
 	}
 
-	uint8_t checksum = 0;
-	for (uint16_t i = 0; i < XMODEM_BLOCK_SIZE; i++) {
-		uint8_t v = ws_serial_getc();
-		checksum += v;
-		if (block != NULL) { 
-			block[i] = v;
+	if (xmodem_crc) {
+		uint16_t crc = 0;
+		for (uint16_t i = 0; i < size; i++) {
+			uint8_t v = xmodem_getc();
+			crc = xmodem_crc_update(crc, v);
+			if (block != NULL) {
+				block[i] = v;
+			}
+		}
+
+		uint16_t crc_actual = xmodem_getc() << 8;
+		crc_actual |= xmodem_getc();
+		return (crc == crc_actual) ? XMODEM_OK : XMODEM_ERROR;
+	} else {
+		uint8_t checksum = 0;
+		for (uint16_t i = 0; i < size; i++) {
+			uint8_t v = xmodem_getc();
+			checksum += v;
+			if (block != NULL) { 
+				block[i] = v;
+			}
 		}
-	}
 
-	uint8_t checksum_actual = ws_serial_getc();
-	return (checksum == checksum_actual) ? XMODEM_OK : XMODEM_ERROR;
+		uint8_t checksum_actual = xmodem_getc();
+		return (checksum == checksum_actual) ? XMODEM_OK : XMODEM_ERROR;
+	}
 }
 
-static void xmodem_write_block(const uint8_t __far* block) {
-	ws_serial_putc(SOH);
-	ws_serial_putc(xmodem_idx);
-	ws_serial_putc(xmodem_idx ^ 0xFF);
+static void xmodem_write_block(const uint8_t __far* block, uint16_t size) {
+	xmodem_putc(size > XMODEM_BLOCK_SIZE ? STX : SOH);
+	xmodem_putc(xmodem_idx);
+	xmodem_putc(xmodem_idx ^ 0xFF);
 
-	uint8_t checksum = 0;
-	for (uint16_t i = 0; i < XMODEM_BLOCK_SIZE; i++) {
-		ws_serial_putc(block[i]);
-		checksum += block[i];
-	}
+	if (xmodem_crc) {
+		uint16_t crc = 0;
+		for (uint16_t i = 0; i < size; i++) {
+			xmodem_putc(block[i]);
+			crc = xmodem_crc_update(crc, block[i]);
+		}
+
+		xmodem_putc(crc >> 8);
+		xmodem_putc(crc);
+	} else {
+		uint8_t checksum = 0;
+		for (uint16_t i = 0; i < size; i++) {
+			xmodem_putc(block[i]);
+			checksum += block[i];
+		}
 
-	ws_serial_putc(checksum);
+		xmodem_putc(checksum);
+	}
 }
 
 uint8_t xmodem_recv_start(void) {
 	xmodem_idx = 1;
-	ws_serial_putc(NAK);
+	xmodem_crc = true;
+	xmodem_crc_requests = XMODEM_CRC_REQUESTS - 1;
+	xmodem_putc(CRC);
 	
 	return XMODEM_OK;
 }
@@ -102,29 +196,48 @@ uint8_t xmodem_recv_block(uint8_t __far* block) {
 	uint8_t retries = 10;
 
 	while (1) {
-		if ((retries--) == 0) return XMODEM_ERROR;
+		if ((retries--) == 0) {
+			if (xmodem_idx != 1 || xmodem_crc_requests == 0xFF) {
+				return XMODEM_ERROR;
+			}
+			// the sender has not answered yet; ask for CRC mode again,
+			// then fall back to checksum mode for older senders
+			retries = 10;
+			if ((xmodem_crc_requests--) != 0) {
+				xmodem_putc(CRC);
+			} else {
+				xmodem_crc = false;
+				xmodem_putc(NAK);
+			}
+		}
 		if (xmodem_poll_exit()) return XMODEM_SELF_CANCEL;
 
-		int16_t r = ws_serial_getc_nonblock();
+		int16_t r = xmodem_getc_nonblock();
 		if (r >= 0) {
 			if (r == CAN) {
 				return XMODEM_CANCEL;
-			} else if (r == SOH) {
-				uint8_t result = xmodem_read_block(block);
+			} else if (r == SOH || r == STX) {
+				uint16_t size = (r == STX) ? XMODEM_BLOCK_SIZE_1K : XMODEM_BLOCK_SIZE;
+				// the sender has picked a mode by now
+				xmodem_crc_requests = 0xFF;
+				uint8_t result = xmodem_read_block(block, size);
 				if (result == XMODEM_OK) {
+					xmodem_block_size = size;
 					return XMODEM_OK;
 				} else if (result == XMODEM_ERROR) {
-					ws_serial_putc(NAK);
+					xmodem_putc(NAK);
 				} else {
-					ws_serial_putc(CAN);
+					xmodem_putc(CAN);
 					return XMODEM_ERROR;
 				}
 			} else if (r == EOT) {
-				ws_serial_putc(ACK);
+				xmodem_putc(ACK);
 				return XMODEM_COMPLETE;
+			} else if (r == STREAM_SYNC && xmodem_buffered && xmodem_idx == 1) {
+				return XMODEM_STREAM;
 			} else {
 				// TODO: Is this right?
-				ws_serial_putc(NAK);
+				xmodem_putc(NAK);
 			}
 		}
 
@@ -133,21 +246,31 @@ uint8_t xmodem_recv_block(uint8_t __far* block) {
 	}
 }
 
+uint16_t xmodem_recv_block_size(void) {
+	return xmodem_block_size;
+}
+
 void xmodem_recv_ack(void) {
 	xmodem_idx++;
-	ws_serial_putc(ACK);
+	xmodem_putc(ACK);
 }
 
 uint8_t xmodem_send_start(void) {
 	xmodem_idx = 1;
 
 	while (!xmodem_poll_exit()) {
-		int16_t r = ws_serial_getc_nonblock();
+		int16_t r = xmodem_getc_nonblock();
 		if (r >= 0) {
 			if (r == CAN) {
 				return XMODEM_CANCEL;
 			} else if (r == NAK) {
+				xmodem_crc = false;
+				return XMODEM_OK;
+			} else if (r == CRC) {
+				xmodem_crc = true;
 				return XMODEM_OK;
+			} else if (r == STREAM_SYNC && xmodem_buffered) {
+				return XMODEM_STREAM;
 			}
 		}
 
@@ -157,19 +280,32 @@ uint8_t xmodem_send_start(void) {
 	return XMODEM_SELF_CANCEL;
 }
 
-uint8_t xmodem_send_block(const uint8_t __far* block) {
+// block being sent, kept for retransmission
+static const uint8_t __far* xmodem_send_ptr;
+static uint16_t xmodem_send_size;
+
+uint16_t xmodem_send_max_block_size(void) {
+	// 1K blocks are only understood by receivers which asked for CRC mode
+	return xmodem_crc ? XMODEM_BLOCK_SIZE_1K : XMODEM_BLOCK_SIZE;
+}
+
+void xmodem_send_block_begin(const uint8_t __far* block, uint16_t size) {
+	xmodem_send_ptr = block;
+	xmodem_send_size = size;
+	xmodem_write_block(block, size);
+}
+
+uint8_t xmodem_send_block_end(void) {
 	uint8_t retries = 10;
-WriteAgain:
-	if ((retries--) == 0) return XMODEM_ERROR;
-	xmodem_write_block(block);
 
 	while (!xmodem_poll_exit()) {
-		int16_t r = ws_serial_getc_nonblock();
+		int16_t r = xmodem_getc_nonblock();
 		if (r >= 0) {
 			if (r == CAN) {
 				return XMODEM_CANCEL;
 			} else if (r == NAK) {
-				goto WriteAgain;
+				if ((--retries) == 0) return XMODEM_ERROR;
+				xmodem_write_block(xmodem_send_ptr, xmodem_send_size);
 			} else if (r == ACK) {
 				xmodem_idx++;
 				return XMODEM_OK;
@@ -182,14 +318,30 @@ WriteAgain:
 	return XMODEM_SELF_CANCEL;
 }
 
+static uint8_t xmodem_send_block_single(const uint8_t __far* block, uint16_t size) {
+	xmodem_send_block_begin(block, size);
+	return xmodem_send_block_end();
+}
+
+uint8_t xmodem_send_block(const uint8_t __far* block, uint16_t size) {
+	if (size > xmodem_send_max_block_size()) {
+		for (uint16_t i = 0; i < size; i += XMODEM_BLOCK_SIZE) {
+			uint8_t result = xmodem_send_block_single(block + i, XMODEM_BLOCK_SIZE);
+			if (result != XMODEM_OK) return result;
+		}
+		return XMODEM_OK;
+	}
+	return xmodem_send_block_single(block, size);
+}
+
 uint8_t xmodem_send_finish(void) {
 	uint8_t retries = 10;
 WriteAgain:
 	if ((retries--) == 0) return XMODEM_ERROR;
-	ws_serial_putc(EOT);
+	xmodem_putc(EOT);
 
 	while (!xmodem_poll_exit()) {
-		int16_t r = ws_serial_getc_nonblock();
+		int16_t r = xmodem_getc_nonblock();
 		if (r >= 0) {
 			if (r == CAN) {
 				return XMODEM_CANCEL;
@@ -27,22 +27,80 @@
 #include <stdint.h>
 
 #define XMODEM_BLOCK_SIZE 128
+#define XMODEM_BLOCK_SIZE_1K 1024
+
+/**
+ * @brief Room for one block, for whichever transfer is running; the stack
+ * has none to spare for a 1K block.
+ */
+extern uint8_t xmodem_block_buffer[XMODEM_BLOCK_SIZE_1K];
 
 #define XMODEM_OK          0 /* OK */
 #define XMODEM_CANCEL      1 /* user cancellation */
 #define XMODEM_SELF_CANCEL 2 /* local cancellation */
 #define XMODEM_ERROR       3 /* transfer error */
 #define XMODEM_COMPLETE    4 /* no more blocks to receive */
+#define XMODEM_STREAM      5 /* the other side asked for the streaming protocol (see stream.h) */
 
+/**
+ * @brief Update a CRC-16 (as used by XMODEM) with len bytes of data.
+ */
+uint16_t xmodem_crc16(uint16_t crc, const uint8_t __far* data, uint16_t len);
 bool xmodem_poll_exit(void);
 
 void xmodem_open(uint8_t baudrate);
+/**
+ * @brief Open the serial port with interrupt-driven reception and
+ * transmission (see serial.h). Data keeps flowing while other work, such as
+ * flash programming, is done between blocks.
+ */
+void xmodem_open_buffered(uint8_t baudrate);
 void xmodem_close(void);
 
+/**
+ * @brief Wait for the receiver to request a transfer.
+ * CRC mode is used if the receiver asks for it with 'C'.
+ */
 uint8_t xmodem_send_start(void);
-uint8_t xmodem_send_block(const uint8_t __far* block);
+/**
+ * @brief Send a block of data.
+ * @param size XMODEM_BLOCK_SIZE or XMODEM_BLOCK_SIZE_1K. 1K blocks are sent
+ * as eight 128-byte blocks if the receiver did not ask for CRC mode.
+ */
+uint8_t xmodem_send_block(const uint8_t __far* block, uint16_t size);
+/**
+ * @return The largest block size the receiver accepts.
+ */
+uint16_t xmodem_send_max_block_size(void);
+/**
+ * @brief Start sending a block of data, without waiting for it to be
+ * acknowledged. In buffered mode, this returns as soon as the tail of the
+ * block fits in the transmit buffer, so that the next block can be prepared
+ * while it is being sent. The block must stay intact until
+ * xmodem_send_block_end() returns, in case it has to be sent again.
+ * @param size At most xmodem_send_max_block_size().
+ */
+void xmodem_send_block_begin(const uint8_t __far* block, uint16_t size);
+/**
+ * @brief Wait for the block started with xmodem_send_block_begin() to be
+ * acknowledged, sending it again if the receiver asks for it.
+ */
+uint8_t xmodem_send_block_end(void);
 uint8_t xmodem_send_finish(void);
 
+/**
+ * @brief Request a transfer from the sender.
+ * CRC mode is requested first; checksum mode is used if the sender does not
+ * answer to it.
+ */
 uint8_t xmodem_recv_start(void);
+/**
+ * @brief Receive a block of data.
+ * @param block Buffer of at least XMODEM_BLOCK_SIZE_1K bytes.
+ */
 uint8_t xmodem_recv_block(uint8_t __far* block);
+/**
+ * @return The size of the last block received, in bytes.
+ */
+uint16_t xmodem_recv_block_size(void);
 void xmodem_recv_ack(void);
\ No newline at end of file
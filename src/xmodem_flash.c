@@ -0,0 +1,813 @@
+/**
+ * Copyright (c) 2023 Adrian Siekierka
+ *
+ * CartFriend is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * CartFriend is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with CartFriend. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <ws.h>
+#include "config.h"
+#include "driver.h"
+#include "serial.h"
+#include "stream.h"
+#include "unpack.h"
+#include "xmodem.h"
+#include "xmodem_flash.h"
+#include "ui.h"
+#include "ws/hardware.h"
+
+#ifdef USE_SLOT_SYSTEM
+
+// Find the entry holding the given bank, counting banks across all entries;
+// bank is made relative to that entry.
+static xmodem_flash_t *xmodem_flash_locate(xmodem_flash_t *state, uint8_t count, uint16_t *bank) {
+    for (uint8_t i = 1; i < count && *bank >= state->bank_count; i++) {
+        *bank -= state->bank_count;
+        state++;
+    }
+    return state;
+}
+
+// Compressed payloads are decoded into SRAM, which holds the contents of the
+// flash bank being written to, as matches may refer back into it. Stream
+// blocks which arrive ahead of the next record are parked in SRAM as well.
+#define XMODEM_FLASH_IMAGE_SRAM_BANK 0
+#define XMODEM_FLASH_PARK_SRAM_BANK 1
+
+// at most this many bank ranges are remembered for resuming
+#define XMODEM_FLASH_RESUME_RANGES 8
+
+typedef struct {
+    xmodem_flash_t *flash;
+    uint8_t count; // number of entries in flash
+    uint16_t banks; // total number of banks
+    uint8_t erased[256 / 8];
+    bool packed; // the payload is compressed (see unpack.h)
+    uint16_t image_bank; // bank held in SRAM, or 0xFFFF
+    uint32_t size; // stream: number of bytes the host is sending
+    uint16_t next; // stream: number of blocks stored in order
+    uint16_t crc; // stream: CRC-16 of these blocks
+    uint32_t parked; // stream: bit i: block next + i has been stored
+    unpack_t unpack;
+    // the bank ranges written to, for resuming
+    struct {
+        uint8_t slot, bank, bank_count;
+    } ranges[XMODEM_FLASH_RESUME_RANGES];
+} xmodem_flash_rx_t;
+
+// Stream transfers which are interrupted can be resumed for as long as
+// CartFriend keeps running, so their state is kept here.
+static xmodem_flash_rx_t xmodem_flash_rx;
+static bool xmodem_flash_rx_resumable;
+
+// Flash is erased in 128 KB sectors, each made of an even bank and the odd
+// one after it; erasing an odd bank on its own does nothing.
+static bool xmodem_flash_rx_erase(xmodem_flash_rx_t *rx, uint16_t bank) {
+    uint16_t first = bank & ~1;
+    for (bank = first; bank < first + 2 && bank < rx->banks; bank++) {
+        uint8_t mask = 1 << (bank & 7);
+        if (rx->erased[bank >> 3] & mask) {
+            continue;
+        }
+        uint16_t entry_bank = bank;
+        xmodem_flash_t *state = xmodem_flash_locate(rx->flash, rx->count, &entry_bank);
+        if (!driver_erase_bank(0, state->slot, state->bank + entry_bank)) {
+            return false;
+        }
+        rx->erased[bank >> 3] |= mask;
+    }
+    return true;
+}
+
+// Program data at the given offset, erasing its bank first if needed.
+static bool xmodem_flash_rx_write(void *userdata, uint32_t offset, const uint8_t *data, uint16_t len) {
+    xmodem_flash_rx_t *rx = userdata;
+    uint16_t bank = offset >> 16;
+
+    if (bank >= rx->banks || !xmodem_flash_rx_erase(rx, bank)) {
+        return false;
+    }
+    if (len != 0) {
+        xmodem_flash_t *state = xmodem_flash_locate(rx->flash, rx->count, &bank);
+        if (!driver_write_slot(data, state->slot, state->bank + bank, offset, len)) {
+            return false;
+        }
+    }
+
+    offset += len;
+    if (offset > rx->flash->offset) {
+        rx->flash->offset = offset;
+        if (rx->flash->progress != NULL) {
+            rx->flash->progress(offset);
+        }
+    }
+    return true;
+}
+
+static uint8_t __far* xmodem_flash_rx_map(void *userdata, uint32_t offset, uint16_t len) {
+    xmodem_flash_rx_t *rx = userdata;
+    uint16_t bank = offset >> 16;
+
+    outportb(IO_BANK_RAM, XMODEM_FLASH_IMAGE_SRAM_BANK);
+    if (bank != rx->image_bank) {
+        // whatever the payload leaves out is erased flash
+        memset(MK_FP(0x1000, 0x0000), 0xFF, 0x8000);
+        memset(MK_FP(0x1000, 0x8000), 0xFF, 0x8000);
+        rx->image_bank = bank;
+    }
+    return MK_FP(0x1000, (uint16_t) offset);
+}
+
+static bool xmodem_flash_rx_commit(void *userdata, uint32_t offset, const uint8_t __far* data, uint16_t len) {
+    // the driver programs from IRAM only; records are never unpacked from
+    // the block buffer (see xmodem_flash_rx_feed)
+    outportb(IO_BANK_RAM, XMODEM_FLASH_IMAGE_SRAM_BANK);
+    memcpy(xmodem_block_buffer, data, len);
+    return xmodem_flash_rx_write(userdata, offset, xmodem_block_buffer, len);
+}
+
+// Unpack an XMODEM block from the block buffer. Programming the records it
+// holds needs the buffer, so the block is moved to SRAM first, and fed from
+// there in pieces smaller than a record: each is collected into the
+// unpacker before map() switches the SRAM bank.
+static bool xmodem_flash_rx_feed(xmodem_flash_rx_t *rx, uint16_t len) {
+    outportb(IO_BANK_RAM, XMODEM_FLASH_PARK_SRAM_BANK);
+    memcpy(MK_FP(0x1000, 0x0000), xmodem_block_buffer, len);
+    for (uint16_t i = 0; i < len; i += XMODEM_BLOCK_SIZE) {
+        outportb(IO_BANK_RAM, XMODEM_FLASH_PARK_SRAM_BANK);
+        if (!unpack_feed(&rx->unpack, MK_FP(0x1000, i), XMODEM_BLOCK_SIZE)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool xmodem_flash_rx_finish(xmodem_flash_rx_t *rx) {
+    if (rx->packed) {
+        if (!unpack_finish(&rx->unpack)) {
+            return false;
+        }
+        rx->flash->offset = rx->unpack.size;
+    }
+    // whatever was not written to is left empty
+    for (uint16_t bank = 0; bank < rx->banks; bank += 2) {
+        ui_step_work_indicator();
+        if (!xmodem_flash_rx_erase(rx, bank)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The checkpoint a transfer is resumed from: the number of blocks stored in
+// order, and their CRC.
+static void xmodem_flash_stream_checkpoint(xmodem_flash_rx_t *rx, const uint8_t *data, uint16_t len) {
+    rx->crc = xmodem_crc16(rx->crc, data, len);
+    rx->next++;
+    rx->parked >>= 1;
+}
+
+// Streaming transfers address flash directly by block index, so blocks can
+// be stored in whatever order they arrive. Compressed payloads send one
+// record per block; records have to be unpacked in order, so those which
+// arrive early wait in SRAM for the ones before them.
+static bool xmodem_flash_stream_store(void *userdata, uint16_t block, const uint8_t *data, uint16_t len) {
+    xmodem_flash_rx_t *rx = userdata;
+
+    if (block == 0) {
+        rx->packed = unpack_is_header(data);
+    }
+    if (!rx->packed) {
+        if (!xmodem_flash_rx_write(rx, (uint32_t) block << 8, data, len)) {
+            return false;
+        }
+        // blocks are never more than a window ahead
+        if (block != rx->next) {
+            rx->parked |= ((uint32_t) 1) << (block - rx->next);
+            return true;
+        }
+        xmodem_flash_stream_checkpoint(rx, data, len);
+        // the blocks which arrived early are read back for the CRC
+        while (rx->parked & 1) {
+            uint8_t buffer[STREAM_BLOCK_SIZE];
+            uint32_t offset = (uint32_t) rx->next << 8;
+            uint16_t bank = rx->next >> 8;
+            len = STREAM_BLOCK_SIZE;
+            if (rx->size != 0 && rx->size - offset < len) {
+                len = rx->size - offset;
+            }
+            xmodem_flash_t *state = xmodem_flash_locate(rx->flash, rx->count, &bank);
+            driver_read_slot(buffer, state->slot, state->bank + bank, (uint16_t) offset, len);
+            xmodem_flash_stream_checkpoint(rx, buffer, len);
+        }
+        return true;
+    }
+
+    if (len != UNPACK_RECORD_SIZE) {
+        return false;
+    }
+    if (block != rx->next) {
+        outportb(IO_BANK_RAM, XMODEM_FLASH_PARK_SRAM_BANK);
+        memcpy(MK_FP(0x1000, (block % STREAM_WINDOW) << 8), data, len);
+        rx->parked |= ((uint32_t) 1) << (block - rx->next);
+        return true;
+    }
+    // Banks are erased ahead of the records (see xmodem_flash_stream_advance),
+    // unless one skips far ahead over empty space; then its bank is erased
+    // here, and the frames the serial buffer cannot hold meanwhile are lost,
+    // and sent again as the gaps are acknowledged.
+    if (!unpack_record(&rx->unpack, data)) {
+        return false;
+    }
+    xmodem_flash_stream_checkpoint(rx, data, len);
+    while (rx->parked & 1) {
+        uint8_t record[UNPACK_RECORD_SIZE];
+        outportb(IO_BANK_RAM, XMODEM_FLASH_PARK_SRAM_BANK);
+        memcpy(record, MK_FP(0x1000, (rx->next % STREAM_WINDOW) << 8), UNPACK_RECORD_SIZE);
+        if (!unpack_record(&rx->unpack, record)) {
+            return false;
+        }
+        xmodem_flash_stream_checkpoint(rx, record, UNPACK_RECORD_SIZE);
+    }
+    return true;
+}
+
+// Uncompressed data is received one bank at a time: the limit is kept at the
+// next bank boundary, so that the sender stops there while the bank is
+// erased. Compressed records decode to at most UNPACK_CHUNK_SIZE bytes each,
+// at ascending offsets; the sector the data has reached and the one after it
+// are erased, and the limit is kept at the number of records which are sure
+// to fit in them.
+static bool xmodem_flash_stream_advance(void *userdata, uint16_t base, uint16_t *limit) {
+    xmodem_flash_rx_t *rx = userdata;
+    uint16_t bank = base >> 8;
+
+    if (base == 0) {
+        // the first block tells whether the payload is compressed
+        *limit = 1;
+        return true;
+    }
+    if (rx->packed) {
+        bank = rx->unpack.end >> 16;
+        if (!xmodem_flash_rx_erase(rx, bank) || !xmodem_flash_rx_erase(rx, bank + 2)) {
+            return false;
+        }
+        uint32_t erased_end = (uint32_t) ((bank & ~1) + 4) << 16;
+        uint32_t records = (erased_end - rx->unpack.end) / UNPACK_CHUNK_SIZE;
+        if (erased_end >= ((uint32_t) rx->banks << 16) || base + records >= 0xFFFF) {
+            *limit = 0xFFFF;
+        } else {
+            *limit = base + records;
+        }
+        return true;
+    }
+    if (bank >= rx->banks) {
+        *limit = base;
+        return true;
+    }
+    if (!xmodem_flash_rx_erase(rx, bank)) {
+        return false;
+    }
+    *limit = bank < 0xFF ? ((bank + 1) << 8) : 0xFFFF;
+    return true;
+}
+
+static void xmodem_flash_rx_init(xmodem_flash_rx_t *rx, xmodem_flash_t *states, uint8_t count) {
+    _nmemset(rx, 0, sizeof(xmodem_flash_rx_t));
+    xmodem_flash_rx_resumable = false;
+    rx->flash = states;
+    rx->count = count;
+    for (uint8_t i = 0; i < count; i++) {
+        rx->banks += states[i].bank_count;
+        if (i < XMODEM_FLASH_RESUME_RANGES) {
+            rx->ranges[i].slot = states[i].slot;
+            rx->ranges[i].bank = states[i].bank;
+            rx->ranges[i].bank_count = states[i].bank_count;
+        }
+    }
+    rx->image_bank = 0xFFFF;
+    unpack_init(&rx->unpack, 0, xmodem_flash_rx_map, xmodem_flash_rx_commit, rx);
+}
+
+bool xmodem_flash_recv_resumable(const xmodem_flash_t *states, uint8_t count) {
+    xmodem_flash_rx_t *rx = &xmodem_flash_rx;
+    if (!xmodem_flash_rx_resumable || rx->next == 0
+        || count != rx->count || count > XMODEM_FLASH_RESUME_RANGES) {
+        return false;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        if (states[i].slot != rx->ranges[i].slot
+            || states[i].bank != rx->ranges[i].bank
+            || states[i].bank_count != rx->ranges[i].bank_count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void xmodem_flash_recv_discard(void) {
+    xmodem_flash_rx_resumable = false;
+}
+
+// Pick up where an interrupted transfer left off. The host sends everything
+// from the checkpoint onwards again; blocks which had arrived early are
+// programmed a second time, with the same data.
+static void xmodem_flash_rx_resume(xmodem_flash_rx_t *rx) {
+    uint16_t bank = rx->image_bank;
+
+    rx->parked = 0;
+    if (!rx->packed || bank == 0xFFFF) {
+        return;
+    }
+    if (!(rx->erased[bank >> 3] & (1 << (bank & 7)))) {
+        // nothing has been programmed into it yet
+        rx->image_bank = 0xFFFF;
+        return;
+    }
+    // SRAM may have been used since; the bank holds everything decoded into
+    // it so far, and is erased past that
+    xmodem_flash_t *state = xmodem_flash_locate(rx->flash, rx->count, &bank);
+    outportb(IO_BANK_RAM, XMODEM_FLASH_IMAGE_SRAM_BANK);
+    for (uint8_t i = 0; i < 2; i++) {
+        ui_step_work_indicator();
+        driver_read_slot_sram(i << 15, state->slot, state->bank + bank, i << 15, 0x8000);
+    }
+}
+
+static uint8_t xmodem_flash_recv_stream(xmodem_flash_rx_t *rx, bool resumable) {
+    stream_resume_t resume = {
+        .size = rx->size,
+        .block = resumable ? rx->next : 0,
+        .crc = rx->crc
+    };
+    uint32_t size;
+    uint8_t result = stream_accept(0, &size, &resume);
+    if (result != XMODEM_OK) {
+        return result;
+    }
+    if (resume.block != 0) {
+        xmodem_flash_rx_resume(rx);
+    } else if (resumable) {
+        xmodem_flash_rx_init(rx, rx->flash, rx->count);
+    }
+    if (size > ((uint32_t) rx->banks << 16)) {
+        return stream_cancel(XMODEM_ERROR);
+    }
+    rx->size = size;
+    // from here on, the transfer can be resumed if it is interrupted
+    xmodem_flash_rx_resumable = size != 0;
+
+    stream_t stream = {
+        .userdata = rx,
+        .start = resume.block,
+        .store = xmodem_flash_stream_store,
+        .advance = xmodem_flash_stream_advance
+    };
+    return stream_recv(&stream);
+}
+
+uint8_t xmodem_flash_recv(xmodem_flash_t *states, uint8_t count) {
+    uint8_t *buffer = xmodem_block_buffer;
+    xmodem_flash_rx_t *rx = &xmodem_flash_rx;
+    uint32_t offset = 0;
+    uint8_t result;
+
+    // the checkpoint is kept until the host picks a way to transfer
+    bool resumable = xmodem_flash_recv_resumable(states, count);
+    if (resumable) {
+        rx->flash = states;
+    } else {
+        xmodem_flash_rx_init(rx, states, count);
+    }
+    uint32_t offset_max = (uint32_t) rx->banks << 16;
+
+    states->offset = 0;
+    if (rx->banks == 0) {
+        return XMODEM_ERROR;
+    }
+
+    driver_unlock();
+
+    // The sender is still waiting for us, so the first bank can be erased
+    // before the transfer is started.
+    if (!xmodem_flash_rx_erase(rx, 0)) {
+        driver_lock();
+        return XMODEM_ERROR;
+    }
+
+    driver_hwint_mask = HWINT_SERIAL_RX | HWINT_SERIAL_TX;
+    result = xmodem_recv_start();
+    while (result == XMODEM_OK) {
+        result = xmodem_recv_block(buffer);
+        if (result == XMODEM_STREAM) {
+            result = xmodem_flash_recv_stream(rx, resumable);
+            break;
+        } else if (result != XMODEM_OK) {
+            break;
+        }
+
+        uint16_t size = xmodem_recv_block_size();
+        if (offset == 0) {
+            if (resumable) {
+                // XMODEM always starts over
+                xmodem_flash_rx_init(rx, states, count);
+                resumable = false;
+                if (!xmodem_flash_rx_erase(rx, 0)) {
+                    result = XMODEM_ERROR;
+                    break;
+                }
+            }
+            rx->packed = unpack_is_header(buffer);
+        }
+        if (rx->packed) {
+            // A block can decode to several times its size, which takes
+            // longer to program than the serial buffer can cover; the
+            // sender waits for the ACK meanwhile. XMODEM delivers records
+            // in order.
+            if (!xmodem_flash_rx_feed(rx, size)) {
+                result = XMODEM_ERROR;
+                break;
+            }
+            xmodem_recv_ack();
+        } else {
+            if (offset + size > offset_max) {
+                result = XMODEM_ERROR;
+                break;
+            }
+
+            // Erasing takes much longer than the serial buffer can cover, so
+            // do it while the sender is still waiting for this block's ACK.
+            if (!((offset + size) & 0xFFFF) && (offset + size) < offset_max) {
+                if (!xmodem_flash_rx_erase(rx, (offset + size) >> 16)) {
+                    result = XMODEM_ERROR;
+                    break;
+                }
+            }
+
+            // Program the block while the next one is being received.
+            xmodem_recv_ack();
+            if (!xmodem_flash_rx_write(rx, offset, buffer, size)) {
+                result = XMODEM_ERROR;
+                break;
+            }
+        }
+        offset += size;
+    }
+
+    if (result == XMODEM_COMPLETE) {
+        xmodem_flash_rx_resumable = false;
+        if (!xmodem_flash_rx_finish(rx)) {
+            result = XMODEM_ERROR;
+        }
+    }
+
+    driver_hwint_mask = 0;
+    driver_lock();
+    return result;
+}
+
+// Each block is read into the block buffer, then sent from a copy in SRAM,
+// which has to stay intact until the block is acknowledged; the next block
+// is read meanwhile.
+#define XMODEM_FLASH_SEND_SRAM_BANK 0
+
+static uint8_t xmodem_flash_send_bank_range(xmodem_flash_t *state) {
+    uint8_t __far* block = MK_FP(0x1000, 0x0000);
+    uint32_t offset_max = (uint32_t) state->bank_count << 16;
+    uint32_t offset = 0;
+    uint16_t size = xmodem_send_max_block_size();
+    uint8_t result = XMODEM_OK;
+
+    if (state->bank_count == 0) {
+        return XMODEM_OK;
+    }
+
+    driver_read_slot(xmodem_block_buffer, state->slot, state->bank, 0, size);
+    while (true) {
+        outportb(IO_BANK_RAM, XMODEM_FLASH_SEND_SRAM_BANK);
+        memcpy(block, xmodem_block_buffer, size);
+        xmodem_send_block_begin(block, size);
+        offset += size;
+        // Only the tail of the block is left in the transmit buffer at this
+        // point; read the next one while it is being sent.
+        if (offset < offset_max) {
+            driver_read_slot(xmodem_block_buffer, state->slot, state->bank + (offset >> 16), (uint16_t) offset, size);
+        }
+        result = xmodem_send_block_end();
+        if (result != XMODEM_OK) {
+            break;
+        }
+
+        state->offset += size;
+        if (state->progress != NULL) {
+            state->progress(state->offset);
+        }
+        if (offset >= offset_max) {
+            break;
+        }
+    }
+
+    return result;
+}
+
+typedef struct {
+    xmodem_flash_t *flash;
+    uint8_t count; // number of entries in flash
+    uint32_t offset; // end of the furthest block loaded so far
+} xmodem_flash_tx_t;
+
+static uint16_t xmodem_flash_stream_load(void *userdata, uint16_t block, uint8_t *data) {
+    xmodem_flash_tx_t *fs = userdata;
+    uint32_t offset = ((uint32_t) (block + 1)) << 8;
+    uint16_t bank = block >> 8;
+
+    xmodem_flash_t *state = xmodem_flash_locate(fs->flash, fs->count, &bank);
+    driver_read_slot(data, state->slot, state->bank + bank, block << 8, STREAM_BLOCK_SIZE);
+
+    if (offset > fs->offset) {
+        fs->offset = offset;
+        if (fs->flash->progress != NULL) {
+            fs->flash->progress(offset);
+        }
+    }
+    return STREAM_BLOCK_SIZE;
+}
+
+static uint8_t xmodem_flash_send_stream(xmodem_flash_t *states, uint8_t count) {
+    uint32_t size = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        size += (uint32_t) states[i].bank_count << 16;
+    }
+
+    uint8_t result = stream_accept(size, NULL, NULL);
+    if (result != XMODEM_OK) {
+        return result;
+    }
+
+    xmodem_flash_tx_t fs = {
+        .flash = states,
+        .count = count
+    };
+    stream_t stream = {
+        .userdata = &fs,
+        .size = size,
+        .load = xmodem_flash_stream_load
+    };
+    return stream_send(&stream);
+}
+
+uint8_t xmodem_flash_send(xmodem_flash_t *states, uint8_t count) {
+    uint32_t offset = 0;
+
+    driver_unlock();
+    // keep the serial buffers going while the slot is being read
+    driver_hwint_mask = HWINT_SERIAL_RX | HWINT_SERIAL_TX;
+
+    uint8_t result = xmodem_send_start();
+    if (result == XMODEM_STREAM) {
+        result = xmodem_flash_send_stream(states, count);
+    } else {
+        for (uint8_t i = 0; i < count && result == XMODEM_OK; i++) {
+            states[i].offset = offset;
+            result = xmodem_flash_send_bank_range(states + i);
+            offset = states[i].offset;
+        }
+        if (result == XMODEM_OK) {
+            result = xmodem_send_finish();
+        }
+    }
+
+    driver_hwint_mask = 0;
+    driver_lock();
+    return result;
+}
+
+// Delta updates work on 4 KB blocks, but the flash can only be erased in
+// 128 KB sectors. Each sector which has changed blocks is copied to SRAM,
+// patched there, then erased and programmed back.
+#define DELTA_BLOCK_SHIFT 12
+#define DELTA_SECTOR_BANKS 2
+#define DELTA_SECTOR_BLOCKS 32
+#define DELTA_MAX_BLOCKS (128 * 16)
+// the number of blocks hashed by one driver call, during which interrupts
+// are disabled
+#define DELTA_HASH_STEP 16
+#define DELTA_HEADER_SIZE 1024
+#define DELTA_PROGRAM_STEP 1024
+// SRAM banks 0 and 1 hold the sector being patched
+#define DELTA_SPILL_SRAM_BANK 2
+
+typedef struct {
+    uint8_t magic[4];
+    uint16_t block_count;
+    uint16_t reserved;
+    uint8_t dirty[DELTA_MAX_BLOCKS / 8];
+} delta_header_t;
+
+typedef struct {
+    xmodem_flash_t *flash;
+    delta_header_t header;
+    uint32_t pos; // position in the patch stream
+    uint16_t block; // block being received, or 0xFFFF
+    uint16_t block_fill;
+    uint8_t sector; // sector copied to SRAM, or 0xFF
+} delta_state_t;
+
+// too large for the stack, like the block the patch is received into
+static delta_state_t xmodem_flash_delta_state;
+
+static inline bool delta_is_dirty(delta_state_t *delta, uint16_t block) {
+    return delta->header.dirty[block >> 3] & (1 << (block & 7));
+}
+
+static uint16_t delta_next_dirty(delta_state_t *delta, uint16_t block) {
+    for (; block < delta->header.block_count; block++) {
+        if (delta_is_dirty(delta, block)) return block;
+    }
+    return 0xFFFF;
+}
+
+static void delta_sector_load(delta_state_t *delta, uint8_t sector) {
+    uint8_t bank = delta->flash->bank + sector * DELTA_SECTOR_BANKS;
+    for (uint8_t i = 0; i < DELTA_SECTOR_BANKS * 2; i++) {
+        ui_step_work_indicator();
+        outportb(IO_BANK_RAM, i >> 1);
+        driver_read_slot_sram((i & 1) << 15, delta->flash->slot, bank + (i >> 1), (i & 1) << 15, 0x8000);
+    }
+    delta->sector = sector;
+}
+
+static bool delta_sector_store(delta_state_t *delta, uint8_t *buffer) {
+    uint8_t bank = delta->flash->bank + delta->sector * DELTA_SECTOR_BANKS;
+    if (!driver_erase_bank(0, delta->flash->slot, bank)) {
+        return false;
+    }
+    for (uint8_t i = 0; i < DELTA_SECTOR_BANKS; i++) {
+        outportb(IO_BANK_RAM, i);
+        uint16_t offset = 0;
+        do {
+            ui_step_work_indicator();
+            memcpy(buffer, MK_FP(0x1000, offset), DELTA_PROGRAM_STEP);
+            // skip padding, which the erase has already taken care of
+            uint16_t j = 0;
+            while (j < DELTA_PROGRAM_STEP && buffer[j] == 0xFF) j++;
+            if (j < DELTA_PROGRAM_STEP) {
+                if (!driver_write_slot(buffer, delta->flash->slot, bank + i, offset, DELTA_PROGRAM_STEP)) {
+                    return false;
+                }
+            }
+            offset += DELTA_PROGRAM_STEP;
+        } while (offset != 0);
+    }
+    delta->sector = 0xFF;
+    return true;
+}
+
+// Process a block of the patch stream: the header, followed by the contents
+// of each dirty block in ascending order.
+static bool delta_consume(delta_state_t *delta, const uint8_t *data, uint16_t len, uint8_t *buffer) {
+    while (len > 0) {
+        uint16_t n;
+        if (delta->pos < DELTA_HEADER_SIZE) {
+            n = DELTA_HEADER_SIZE - delta->pos;
+            if (n > len) n = len;
+            if (delta->pos < sizeof(delta_header_t)) {
+                uint16_t header_n = sizeof(delta_header_t) - delta->pos;
+                if (header_n > n) header_n = n;
+                memcpy(((uint8_t*) &delta->header) + delta->pos, data, header_n);
+            }
+            if (delta->pos + n == DELTA_HEADER_SIZE) {
+                if (memcmp(delta->header.magic, "CFDP", 4)
+                    || delta->header.block_count != (delta->flash->bank_count << 4)) {
+                    return false;
+                }
+                delta->block = delta_next_dirty(delta, 0);
+                delta->block_fill = 0;
+            }
+        } else {
+            if (delta->block == 0xFFFF) {
+                // all dirty blocks are in; the rest is block padding
+                break;
+            }
+            uint8_t sector = delta->block / DELTA_SECTOR_BLOCKS;
+            if (delta->sector != sector) {
+                if (delta->sector != 0xFF) {
+                    // storing the sector needs the buffer the rest of this
+                    // block was received into, so park it in SRAM meanwhile
+                    outportb(IO_BANK_RAM, DELTA_SPILL_SRAM_BANK);
+                    memcpy(MK_FP(0x1000, 0x0000), data, len);
+                    if (!delta_sector_store(delta, buffer)) {
+                        return false;
+                    }
+                    outportb(IO_BANK_RAM, DELTA_SPILL_SRAM_BANK);
+                    memcpy(buffer, MK_FP(0x1000, 0x0000), len);
+                    data = buffer;
+                }
+                delta_sector_load(delta, sector);
+            }
+
+            n = (1 << DELTA_BLOCK_SHIFT) - delta->block_fill;
+            if (n > len) n = len;
+            uint32_t sram_offset = ((uint32_t) (delta->block % DELTA_SECTOR_BLOCKS) << DELTA_BLOCK_SHIFT) + delta->block_fill;
+            outportb(IO_BANK_RAM, sram_offset >> 16);
+            memcpy(MK_FP(0x1000, (uint16_t) sram_offset), data, n);
+
+            delta->block_fill += n;
+            if (delta->block_fill == (1 << DELTA_BLOCK_SHIFT)) {
+                delta->block = delta_next_dirty(delta, delta->block + 1);
+                delta->block_fill = 0;
+            }
+        }
+        delta->pos += n;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+static uint8_t delta_send_hashes(xmodem_flash_t *state, uint8_t *buffer) {
+    uint16_t blocks = state->bank_count << 4;
+    uint8_t result = xmodem_send_start();
+
+    for (uint16_t block = 0; block < blocks && result == XMODEM_OK; block += XMODEM_BLOCK_SIZE_1K / 4) {
+        memset(buffer, 0xFF, XMODEM_BLOCK_SIZE_1K);
+        for (uint16_t i = 0; i < XMODEM_BLOCK_SIZE_1K / 4 && block + i < blocks; i += DELTA_HASH_STEP) {
+            ui_step_work_indicator();
+            driver_hash_slot(((uint32_t*) buffer) + i, state->slot, state->bank + ((block + i) >> 4), 0, DELTA_HASH_STEP);
+        }
+        result = xmodem_send_block(buffer, XMODEM_BLOCK_SIZE_1K);
+    }
+    if (result == XMODEM_OK) {
+        result = xmodem_send_finish();
+    }
+    return result;
+}
+
+uint8_t xmodem_flash_delta(xmodem_flash_t *state) {
+    uint8_t *buffer = xmodem_block_buffer;
+    delta_state_t *delta = &xmodem_flash_delta_state;
+    uint8_t result;
+
+    state->offset = 0;
+    if (state->bank_count == 0 || state->bank_count > DELTA_MAX_BLOCKS / 16 || (state->bank & 1)) {
+        return XMODEM_ERROR;
+    }
+    _nmemset(delta, 0, sizeof(delta_state_t));
+    delta->flash = state;
+    xmodem_flash_recv_discard();
+    delta->block = 0xFFFF;
+    delta->sector = 0xFF;
+
+    driver_unlock();
+    result = delta_send_hashes(state, buffer);
+    if (result == XMODEM_OK) {
+        result = xmodem_recv_start();
+    }
+    while (result == XMODEM_OK) {
+        result = xmodem_recv_block(buffer);
+        if (result != XMODEM_OK) {
+            break;
+        }
+        // The sender waits for the ACK, so all the slow work - loading,
+        // erasing and programming sectors - happens before sending it.
+        if (!delta_consume(delta, buffer, xmodem_recv_block_size(), buffer)) {
+            result = XMODEM_ERROR;
+            break;
+        }
+        xmodem_recv_ack();
+
+        state->offset = delta->pos;
+        if (state->progress != NULL) {
+            state->progress(state->offset);
+        }
+    }
+
+    if (result == XMODEM_COMPLETE) {
+        if (delta->pos < DELTA_HEADER_SIZE || delta->block != 0xFFFF) {
+            // the patch ended early
+            result = XMODEM_ERROR;
+        } else if (delta->sector != 0xFF && !delta_sector_store(delta, buffer)) {
+            result = XMODEM_ERROR;
+        }
+    }
+
+    driver_lock();
+    return result;
+}
+
+#endif
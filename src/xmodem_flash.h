@@ -0,0 +1,88 @@
+#pragma once
+/**
+ * Copyright (c) 2023 Adrian Siekierka
+ *
+ * CartFriend is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * CartFriend is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with CartFriend. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// CartFriend - XMODEM transfers to and from flash
+//
+// Blocks are programmed into a game slot as they arrive, or read from it as
+// they are sent. The serial port is opened in buffered mode, and the serial
+// interrupts stay enabled while the flash driver runs, so data keeps flowing
+// while the current block is being programmed or the next one is being read.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wonderful.h>
+
+typedef struct {
+	uint8_t slot;
+	uint8_t bank; // first bank to access
+	uint8_t bank_count; // (maximum) number of 64 KB banks to access
+	uint32_t offset; // number of bytes transferred so far
+	void (*progress)(uint32_t offset); // optional
+} xmodem_flash_t;
+
+/**
+ * @brief Receive a file over XMODEM, or the streaming protocol if the sender
+ * asks for it, and program it into one or more bank ranges of flash.
+ * The file may be a compressed payload (see unpack.h), which is decoded
+ * through SRAM; SRAM must not hold any save data then.
+ * The serial port must have been opened with xmodem_open_buffered().
+ * Each bank is erased before it is first written to; banks the file does
+ * not reach are erased at the end. The progress callback of the first entry
+ * is called with the furthest offset written so far, and its offset is set
+ * to the size of the file once it has been received.
+ * If a streaming transfer to the same bank ranges was interrupted before,
+ * the host may resume it (see xmodem_flash_recv_resumable).
+ * @return XMODEM_COMPLETE if the whole file was received.
+ */
+uint8_t xmodem_flash_recv(xmodem_flash_t *states, uint8_t count);
+
+/**
+ * @brief Check whether the last transfer to these bank ranges was a
+ * streaming one which got interrupted. The cartridge remembers how many
+ * blocks it had stored in order, and their CRC; a host which supports it
+ * checks the CRC against its file and continues from there.
+ * This lasts until another transfer is started, or CartFriend is left.
+ */
+bool xmodem_flash_recv_resumable(const xmodem_flash_t *states, uint8_t count);
+
+/**
+ * @brief Forget the interrupted transfer, if any, so that the next one
+ * starts over; for instance, as the flash it was writing to is about to be
+ * changed otherwise.
+ */
+void xmodem_flash_recv_discard(void);
+
+/**
+ * @brief Send the contents of one or more bank ranges of flash as one file,
+ * over XMODEM or the streaming protocol, as picked by the receiver.
+ * The progress callback of each entry is called with the overall offset.
+ * SRAM is used as scratch space, so it must not hold any save data.
+ * The serial port must have been opened with xmodem_open_buffered().
+ * @return XMODEM_OK if everything was sent.
+ */
+uint8_t xmodem_flash_send(xmodem_flash_t *states, uint8_t count);
+
+/**
+ * @brief Update the contents of a flash slot in place.
+ * The hashes of all 4 KB blocks are sent first; the sender then answers with
+ * a patch holding only the blocks which differ (see tools/cf_delta.py).
+ * SRAM is used as scratch space, so it must not hold any save data.
+ * The serial port must have been opened with xmodem_open_buffered().
+ * @return XMODEM_COMPLETE if the whole patch was applied.
+ */
+uint8_t xmodem_flash_delta(xmodem_flash_t *state);
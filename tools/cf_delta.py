@@ -0,0 +1,101 @@
+#!/usr/bin/python3
+#
+# Copyright (c) 2023 Adrian Siekierka
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+# WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+# MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+# SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+# RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+# CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+# CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+# Host side of "Tools -> Update ROM (Serial)".
+#
+# 1. The cartridge sends, over XMODEM, a 32-bit hash of each 4 KB block of
+#    the selected slot region: the low word is the 16-bit sum of all bytes,
+#    the high word the 16-bit sum of all running sums (little endian).
+# 2. This tool answers, over XMODEM, with a patch: a 1024-byte header
+#    ("CFDP", block count as uint16, 2 reserved bytes, then a bitmap of the
+#    blocks which differ, LSB first), followed by the contents of each of
+#    these blocks in ascending order.
+#
+# The cartridge then rewrites only the 128 KB erase sectors which contain
+# changed blocks.
+
+from pathlib import Path
+import argparse
+import struct
+import sys
+import time
+
+import cf_xmodem
+
+BLOCK_SIZE = 4096
+SECTOR_SIZE = 131072
+HEADER_SIZE = 1024
+
+def block_hash(block):
+    # sum2 is the sum of all running sums, i.e. each byte weighted by the
+    # number of sums it takes part in
+    n = len(block)
+    s1 = sum(block)
+    s2 = sum((n - i) * b for i, b in enumerate(block))
+    return (s1 & 0xFFFF) | ((s2 & 0xFFFF) << 16)
+
+def image_hashes(image):
+    return [block_hash(image[i:i+BLOCK_SIZE]) for i in range(0, len(image), BLOCK_SIZE)]
+
+def build_patch(image, local_hashes, remote_hashes):
+    blocks = len(image) // BLOCK_SIZE
+    dirty = [i for i in range(blocks) if local_hashes[i] != remote_hashes[i]]
+
+    bitmap = bytearray(blocks // 8)
+    for i in dirty:
+        bitmap[i >> 3] |= 1 << (i & 7)
+    header = b"CFDP" + struct.pack("<HH", blocks, 0) + bitmap
+    header += bytes(HEADER_SIZE - len(header))
+    patch = header + b"".join(image[i*BLOCK_SIZE:(i+1)*BLOCK_SIZE] for i in dirty)
+    return dirty, patch
+
+def main(args):
+    image = Path(args.rom).read_bytes()
+    if len(image) == 0 or len(image) % SECTOR_SIZE != 0:
+        print("error: the ROM size must be a multiple of 128 KB", file=sys.stderr)
+        return 1
+    blocks = len(image) // BLOCK_SIZE
+    # The cartridge only waits a moment between sending the hashes and
+    # receiving the patch, so hash the image up front.
+    local_hashes = image_hashes(image)
+
+    port = cf_xmodem.open_port(args.port, args.baudrate)
+    xm = cf_xmodem.XModem(port)
+    start = time.monotonic()
+
+    print("Receiving block hashes...")
+    hash_data = xm.recv()
+    if len(hash_data) < blocks * 4 or len(hash_data) >= blocks * 4 + 1024:
+        print("error: the cartridge is set up for a ROM of a different size", file=sys.stderr)
+        return 1
+    remote_hashes = struct.unpack("<%dI" % blocks, hash_data[:blocks * 4])
+
+    dirty, patch = build_patch(image, local_hashes, remote_hashes)
+    sectors = len(set(i * BLOCK_SIZE // SECTOR_SIZE for i in dirty))
+    print("%d of %d blocks changed, in %d sector(s); sending %d bytes..." % (len(dirty), blocks, sectors, len(patch)))
+
+    def progress(pos, total):
+        print("\r%d/%d bytes" % (pos, total), end="", flush=True)
+    xm.send(patch, progress=progress)
+    print()
+    print("Done in %.1f seconds." % (time.monotonic() - start))
+    return 0
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Update a ROM installed on a CartFriend cartridge, sending only the changed blocks")
+    parser.add_argument("-p", "--port", required=True, help="serial port connected to the EXT port")
+    parser.add_argument("-b", "--baudrate", type=int, default=38400, choices=[9600, 38400])
+    parser.add_argument("rom", help="new ROM image (.ws/.wsc)")
+    sys.exit(main(parser.parse_args()))
@@ -0,0 +1,229 @@
+#!/usr/bin/python3
+#
+# Copyright (c) 2023 Adrian Siekierka
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+# WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+# MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+# SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+# RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+# CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+# CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+# Compressor for CartFriend's compressed payloads (see src/unpack.h), which
+# the serial Tools entries accept in place of a plain file.
+#
+# A payload is a sequence of 256-byte records. The first one is the header:
+#
+#   "CFZ", version (1), decoded size (uint32 LE), record count (uint16 LE),
+#   including the header
+#
+# Every other record decodes to up to 1024 bytes:
+#
+#   offset (uint32 LE), decoded length (uint16 LE), stream length (uint16 LE),
+#   LZSS stream
+#
+# Offsets are ascending, and chunks never cross a 64 KB boundary. Runs of
+# 0xFF bytes are left out, and so is the unused tail of each record. For
+# every 64 KB bank which would not get a record otherwise, an empty one
+# (decoded length 0) at its start is written instead, so that the cartridge
+# never has to erase more than one flash bank per record.
+#
+# The LZSS stream is a flag byte before every eight items, least significant
+# bit first. A set bit is a literal byte; a clear bit a match word (LE), with
+# the distance - 1 in its low 12 bits and the length - 3 in its high 4 bits.
+# Matches may refer back to anything decoded earlier in the same 64 KB bank,
+# in this record or the ones before it, with the bytes left out counting as
+# 0xFF; records are decoded in order.
+
+import argparse
+import struct
+import sys
+
+VERSION = 1
+RECORD_SIZE = 256
+RECORD_HEADER_SIZE = 8
+CHUNK_SIZE = 1024
+BANK_SIZE = 0x10000
+MIN_MATCH = 3
+MAX_MATCH = 18
+MAX_DISTANCE = 4096
+# runs of 0xFF at least this long end a record
+SKIP_RUN = 32
+MAX_CANDIDATES = 48
+
+class PackError(Exception):
+    pass
+
+def _ff_run(data, pos, limit):
+    end = pos
+    while end < limit and data[end] == 0xFF:
+        end += 1
+    return end - pos
+
+class _Matcher:
+    """Finds matches within the current bank, up to MAX_DISTANCE back."""
+
+    def __init__(self, data, bank_start):
+        self.data = data
+        self.heads = {}
+        self.pos = bank_start
+
+    def insert_to(self, end):
+        data = self.data
+        while self.pos < end:
+            if self.pos + MIN_MATCH <= len(data):
+                self.heads.setdefault(bytes(data[self.pos:self.pos + MIN_MATCH]), []).append(self.pos)
+            self.pos += 1
+
+    def find(self, p, limit):
+        data = self.data
+        best_len, best_dist = 0, 0
+        if p + MIN_MATCH > limit:
+            return best_len, best_dist
+        max_len = min(MAX_MATCH, limit - p)
+        candidates = self.heads.get(bytes(data[p:p + MIN_MATCH]), [])
+        for cand in reversed(candidates[-MAX_CANDIDATES:]):
+            if cand >= p:
+                # inserted ahead, by lazy matching
+                continue
+            if p - cand > MAX_DISTANCE:
+                break
+            length = 0
+            while length < max_len and data[cand + length] == data[p + length]:
+                length += 1
+            if length > best_len:
+                best_len, best_dist = length, p - cand
+                if length == max_len:
+                    break
+        return best_len, best_dist
+
+def _encode_chunk(data, matcher, start, limit):
+    """Compress as much of data[start:limit] as fits into one record."""
+    budget = RECORD_SIZE - RECORD_HEADER_SIZE
+    out = bytearray()
+    flag_pos = 0
+    items = 0
+    pos = start
+
+    while pos < limit:
+        if pos > start and _ff_run(data, pos, min(limit, pos + SKIP_RUN)) == SKIP_RUN:
+            break
+        matcher.insert_to(pos)
+        length, dist = matcher.find(pos, limit)
+        if length >= MIN_MATCH and length < MAX_MATCH and pos + 1 < limit:
+            # lazy matching: prefer a literal if the next match is longer
+            matcher.insert_to(pos + 1)
+            next_length, _ = matcher.find(pos + 1, limit)
+            if next_length > length + 1:
+                length = 0
+        size = (2 if length >= MIN_MATCH else 1) + (1 if items % 8 == 0 else 0)
+        if len(out) + size > budget:
+            break
+        if items % 8 == 0:
+            flag_pos = len(out)
+            out.append(0)
+        if length >= MIN_MATCH:
+            out += struct.pack("<H", (dist - 1) | ((length - MIN_MATCH) << 12))
+        else:
+            out[flag_pos] |= 1 << (items % 8)
+            out.append(data[pos])
+            length = 1
+        items += 1
+        pos += length
+    return bytes(out), pos - start
+
+def _record(offset, length, stream):
+    record = struct.pack("<IHH", offset, length, len(stream)) + stream
+    return record + bytes(RECORD_SIZE - len(record))
+
+def pack(data):
+    records = []
+    last_bank = -1
+    matcher = None
+    pos = 0
+    while True:
+        pos += _ff_run(data, pos, len(data))
+        bank = pos // BANK_SIZE if pos < len(data) else (len(data) - 1) // BANK_SIZE + 1
+        for empty in range(last_bank + 1, bank):
+            records.append(_record(empty * BANK_SIZE, 0, b""))
+        if pos >= len(data):
+            break
+        if bank != last_bank:
+            matcher = _Matcher(data, bank * BANK_SIZE)
+        last_bank = bank
+        limit = min(len(data), pos + CHUNK_SIZE, (bank + 1) * BANK_SIZE)
+        stream, length = _encode_chunk(data, matcher, pos, limit)
+        records.append(_record(pos, length, stream))
+        pos += length
+    header = struct.pack("<3sBIH", b"CFZ", VERSION, len(data), len(records) + 1)
+    return header + bytes(RECORD_SIZE - len(header)) + b"".join(records)
+
+def _lzss_decode(stream, out, start, length):
+    """Decode stream into out[start:start + length], with out[:start] as the
+    history."""
+    end = start + length
+    floor = max(start - (start % BANK_SIZE), start - MAX_DISTANCE)
+    pos = 0
+    flags = 1
+    p = start
+    while p < end:
+        if flags == 1:
+            flags = 0x100 | stream[pos]
+            pos += 1
+        literal = flags & 1
+        flags >>= 1
+        if literal:
+            out[p] = stream[pos]
+            pos += 1
+            p += 1
+        else:
+            word = stream[pos] | (stream[pos + 1] << 8)
+            pos += 2
+            dist = (word & 0xFFF) + 1
+            count = (word >> 12) + MIN_MATCH
+            if p - dist < floor or p + count > end:
+                raise PackError("invalid match")
+            for _ in range(count):
+                out[p] = out[p - dist]
+                p += 1
+
+def unpack(payload):
+    """Reference decoder, matching src/unpack.c."""
+    magic, version, size, count = struct.unpack("<3sBIH", payload[:10])
+    if magic != b"CFZ" or version != VERSION:
+        raise PackError("not a compressed payload")
+    data = bytearray(b"\xFF" * size)
+    end = 0
+    for i in range(1, count):
+        record = payload[i * RECORD_SIZE:(i + 1) * RECORD_SIZE]
+        offset, length, stream_length = struct.unpack("<IHH", record[:8])
+        if offset < end or offset + length > size or (offset % BANK_SIZE) + length > BANK_SIZE:
+            raise PackError("invalid record")
+        if length:
+            _lzss_decode(record[8:8 + stream_length], data, offset, length)
+        end = offset + length
+    return bytes(data)
+
+def is_packed(payload):
+    return payload[:4] == b"CFZ" + bytes([VERSION])
+
+def main(args):
+    with open(args.input, "rb") as f:
+        data = f.read()
+    payload = pack(data)
+    if unpack(payload) != data:
+        raise PackError("round trip failed")
+    with open(args.output, "wb") as f:
+        f.write(payload)
+    print("%d -> %d bytes (%.1f%%)" % (len(data), len(payload), 100 * len(payload) / max(1, len(data))))
+    return 0
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Compress a file for sending to a CartFriend cartridge over serial")
+    parser.add_argument("input")
+    parser.add_argument("output")
+    sys.exit(main(parser.parse_args()))
@@ -0,0 +1,300 @@
+#!/usr/bin/python3
+#
+# Copyright (c) 2023 Adrian Siekierka
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+# WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+# MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+# SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+# RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+# CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+# CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+# Client for CartFriend's serial command server ("Tools -> Command server
+# (Serial)", see src/remote.h), for managing cartridges from scripts.
+#
+# Requests and replies are frames as used by cf_stream.py; the sequence
+# number of each request is echoed by its reply. A failed request is
+# answered with an 'N' frame holding an error code instead. A request is
+# sent again, with the same sequence number, until it is answered; the
+# cartridge only carries it out once. Requests (reply after the arrow):
+#
+#   'i' -> server version, game slots, save blocks, launcher slot, active
+#          save block (0xFF: none), settings version (uint16 LE), settings
+#          size (uint16 LE), then the 8 flash banks of each save block
+#   'l' slot -> slot type, slot name (24 bytes), then the 9-byte catalog
+#          entries of the slot: ID (slot | sub-slot << 4), publisher ID,
+#          game ID, game version, ROM size, save type, checksum (uint16 LE),
+#          flags
+#   'r' slot, bank, offset (uint16 LE), length (uint16 LE, <= 256) -> data
+#   'w' slot, bank, offset (uint16 LE), data: program flash; it has to be
+#          erased first
+#   'e' slot, bank: erase the 128 KB sector starting at an even bank
+#   'g' offset (uint16 LE), length (uint16 LE, <= 256) -> settings data
+#   'p' offset (uint16 LE), data: change settings in memory; the magic,
+#          version, active save block and launcher slot are kept
+#   's' store the settings to flash
+#   'm' save block, or 0xFF: write the active save block back to flash,
+#          then load the given one into SRAM
+#   'b' catalog ID: launch; the server exits after replying
+#
+# In the launcher's slot, only the banks of save blocks other than the
+# active one may be written to or erased.
+
+import argparse
+import random
+import struct
+import sys
+import time
+
+import cf_stream
+import cf_xmodem
+
+VERSION = 1
+NAK = ord('N')
+ERRORS = {
+    1: "unknown command",
+    2: "invalid arguments",
+    3: "protected flash area",
+    4: "flash error",
+}
+
+BANK_SIZE = 0x10000
+SECTOR_BANKS = 2
+SAVE_BANKS = 8
+READ_SIZE = 256
+# buffered flash writes must stay within a 512-byte page
+WRITE_SIZE = 128
+SETTINGS_HEADER_SIZE = 6
+RESEND_TIMEOUT = 1.0
+# in ROM headers, in mbits
+ROM_SIZES = [1, 2, 4, 8, 16, 24, 32, 48, 62, 128]
+SLOT_TYPES = {0: "Soft", 1: "Launcher", 2: "MultiLinearSoft", 3: "AppendedFiles", 0xFF: "Unused"}
+
+class RemoteError(Exception):
+    pass
+
+class Info:
+    def __init__(self, data):
+        (self.version, self.game_slots, self.save_blocks, self.launcher_slot,
+            self.active_save, self.settings_version, self.settings_size) = struct.unpack("<BBBBBHH", data[:9])
+        banks = data[9:]
+        self.save_banks = [list(banks[i * SAVE_BANKS:(i + 1) * SAVE_BANKS]) for i in range(self.save_blocks)]
+
+class Remote:
+    def __init__(self, port):
+        self.port = port
+        self.reader = cf_stream.FrameReader()
+        self.seq = random.randrange(0x10000)
+
+    def request(self, cmd, payload=b"", timeout=10.0):
+        """Send a request until it is answered; return the reply's payload."""
+        self.seq = (self.seq + 1) & 0xFFFF
+        frame = cf_stream.encode_frame(ord(cmd), self.seq, payload)
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            self.port.write(frame)
+            resend = min(deadline, time.monotonic() + RESEND_TIMEOUT)
+            while time.monotonic() < resend:
+                self.port.timeout = 0.05
+                data = self.port.read(max(1, self.port.in_waiting))
+                for ftype, seq, reply in self.reader.feed(data) if data else []:
+                    # replies to earlier requests may arrive more than once
+                    if seq != self.seq:
+                        continue
+                    if ftype == NAK:
+                        code = reply[0] if reply else 0
+                        raise RemoteError("'%s' failed: %s" % (cmd, ERRORS.get(code, "error %d" % code)))
+                    if ftype == ord(cmd):
+                        return reply
+        raise RemoteError("no reply to '%s'" % cmd)
+
+    def info(self):
+        info = Info(self.request('i'))
+        if info.version != VERSION:
+            raise RemoteError("unsupported server version %d" % info.version)
+        return info
+
+    def list_slot(self, slot):
+        # the catalog may have to be rebuilt first
+        data = self.request('l', bytes([slot]), timeout=60.0)
+        name = data[1:25].split(b"\0")[0]
+        entries = []
+        for i in range(25, len(data) - 8, 9):
+            entries.append(struct.unpack("<BBBBBBHB", data[i:i + 9]))
+        return data[0], name, entries
+
+    def read(self, slot, bank, offset, length):
+        return self.request('r', struct.pack("<BBHH", slot, bank, offset, length))
+
+    def write(self, slot, bank, offset, data):
+        self.request('w', struct.pack("<BBH", slot, bank, offset) + data)
+
+    def erase(self, slot, bank):
+        self.request('e', bytes([slot, bank]), timeout=30.0)
+
+    def get_settings(self, offset, length):
+        return self.request('g', struct.pack("<HH", offset, length))
+
+    def put_settings(self, offset, data):
+        self.request('p', struct.pack("<H", offset) + data)
+
+    def save_settings(self):
+        self.request('s', timeout=30.0)
+
+    def mount(self, block):
+        # copying a save block between flash and SRAM takes a while
+        self.request('m', bytes([block]), timeout=120.0)
+
+    def launch(self, entry_id):
+        self.request('b', bytes([entry_id]))
+
+    def read_banks(self, slot, banks, progress=None):
+        out = bytearray()
+        for bank in banks:
+            for offset in range(0, BANK_SIZE, READ_SIZE):
+                out += self.read(slot, bank, offset, READ_SIZE)
+                if progress:
+                    progress(len(out))
+        return bytes(out)
+
+    def write_banks(self, slot, banks, data, progress=None):
+        """Erase the sectors holding banks, then program data into them;
+        runs of 0xFF are left as erased."""
+        for bank in sorted(set(b & ~(SECTOR_BANKS - 1) for b in banks)):
+            self.erase(slot, bank)
+        for i, bank in enumerate(banks):
+            for offset in range(0, BANK_SIZE, WRITE_SIZE):
+                chunk = data[i * BANK_SIZE + offset:i * BANK_SIZE + offset + WRITE_SIZE]
+                if chunk.strip(b"\xFF"):
+                    self.write(slot, bank, offset, chunk)
+                if progress:
+                    progress(i * BANK_SIZE + offset + len(chunk))
+
+def _bank_range(start, count):
+    if start + count > 0x100:
+        raise RemoteError("bank range past the end of the slot")
+    return list(range(start, start + count))
+
+def _save_banks(remote, info, block, flush):
+    if block >= info.save_blocks:
+        raise RemoteError("no such save block")
+    if flush and info.active_save == block:
+        # its current contents are in SRAM
+        print("Writing the active save block back to flash...")
+        remote.mount(0xFF)
+    return info.save_banks[block]
+
+def main(args):
+    port = cf_xmodem.open_port(args.port, args.baudrate)
+    remote = Remote(port)
+    info = remote.info()
+
+    def progress(pos):
+        print("\r%d bytes" % pos, end="", flush=True)
+
+    if args.command == "info":
+        print("Launcher slot: %d" % info.launcher_slot)
+        print("Active save block: %s" % ("none" if info.active_save >= info.save_blocks else info.active_save))
+        print("Settings: version %d, %d bytes" % (info.settings_version, info.settings_size))
+    elif args.command == "list":
+        for slot in range(info.game_slots):
+            slot_type, name, entries = remote.list_slot(slot)
+            print("Slot %2d: %s %s" % (slot, SLOT_TYPES.get(slot_type, "type %d" % slot_type), name.decode("ascii", "replace")))
+            for entry_id, publisher, game, version, rom_size, save_type, checksum, flags in entries:
+                top = 0xFF - (entry_id & 0xF0)
+                banks = ROM_SIZES[rom_size] * 2 if rom_size < len(ROM_SIZES) else 0
+                print("  ID %02X: %02X-%02X v%d, banks %02X-%02X, save type %02X, checksum %04X" % (
+                    entry_id, publisher, game, version, top + 1 - banks, top, save_type, checksum))
+    elif args.command == "read":
+        data = remote.read_banks(args.slot, _bank_range(args.bank, args.count), progress)
+        print()
+        with open(args.file, "wb") as f:
+            f.write(data)
+    elif args.command == "write":
+        with open(args.file, "rb") as f:
+            data = f.read()
+        count = (len(data) + BANK_SIZE - 1) // BANK_SIZE
+        if args.bank % SECTOR_BANKS or count % SECTOR_BANKS:
+            raise RemoteError("whole 128 KB sectors have to be written")
+        data += b"\xFF" * (count * BANK_SIZE - len(data))
+        banks = _bank_range(args.bank, count)
+        remote.write_banks(args.slot, banks, data, progress)
+        print()
+        if args.verify and remote.read_banks(args.slot, banks) != data:
+            raise RemoteError("verification failed")
+    elif args.command == "erase":
+        for bank in _bank_range(args.bank, args.count)[::SECTOR_BANKS]:
+            remote.erase(args.slot, bank)
+    elif args.command == "save-get":
+        banks = _save_banks(remote, info, args.block, True)[:args.banks]
+        data = remote.read_banks(info.launcher_slot, banks, progress)
+        print()
+        with open(args.file, "wb") as f:
+            f.write(data)
+    elif args.command == "save-put":
+        banks = _save_banks(remote, info, args.block, True)
+        with open(args.file, "rb") as f:
+            data = f.read()
+        if len(data) > len(banks) * BANK_SIZE:
+            raise RemoteError("file larger than a save block")
+        data += b"\xFF" * (len(banks) * BANK_SIZE - len(data))
+        remote.write_banks(info.launcher_slot, banks, data, progress)
+        print()
+    elif args.command == "settings-get":
+        data = b"".join(remote.get_settings(offset, min(READ_SIZE, info.settings_size - offset))
+            for offset in range(0, info.settings_size, READ_SIZE))
+        with open(args.file, "wb") as f:
+            f.write(data)
+    elif args.command == "settings-put":
+        with open(args.file, "rb") as f:
+            data = f.read()
+        if len(data) != info.settings_size or struct.unpack("<H", data[4:6])[0] != info.settings_version:
+            raise RemoteError("settings do not match this version of CartFriend")
+        for offset in range(SETTINGS_HEADER_SIZE, len(data), WRITE_SIZE):
+            remote.put_settings(offset, data[offset:offset + WRITE_SIZE])
+        remote.save_settings()
+    elif args.command == "mount":
+        remote.mount(0xFF if args.block < 0 else args.block)
+    elif args.command == "launch":
+        remote.launch(args.id)
+    return 0
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Manage a CartFriend cartridge running the serial command server")
+    parser.add_argument("-p", "--port", required=True, help="serial port connected to the EXT port")
+    parser.add_argument("-b", "--baudrate", type=int, default=38400, choices=[9600, 38400])
+    commands = parser.add_subparsers(dest="command", required=True)
+    commands.add_parser("info", help="show the cartridge's configuration")
+    commands.add_parser("list", help="list slots and the software installed in them")
+    for name, text in (("read", "read banks of a slot to a file"), ("erase", "erase banks of a slot")):
+        command = commands.add_parser(name, help=text)
+        command.add_argument("slot", type=int)
+        command.add_argument("bank", type=lambda x: int(x, 0))
+        command.add_argument("count", type=lambda x: int(x, 0))
+        if name == "read":
+            command.add_argument("file")
+    command = commands.add_parser("write", help="erase banks of a slot, then write a file to them")
+    command.add_argument("--verify", action="store_true", help="read the data back afterwards")
+    command.add_argument("slot", type=int)
+    command.add_argument("bank", type=lambda x: int(x, 0))
+    command.add_argument("file")
+    command = commands.add_parser("save-get", help="read a save block to a file")
+    command.add_argument("--banks", type=int, default=SAVE_BANKS, help="number of 64 KB banks to read")
+    command.add_argument("block", type=int)
+    command.add_argument("file")
+    command = commands.add_parser("save-put", help="replace the contents of a save block")
+    command.add_argument("block", type=int)
+    command.add_argument("file")
+    command = commands.add_parser("settings-get", help="read the settings to a file")
+    command.add_argument("file")
+    command = commands.add_parser("settings-put", help="replace the settings with a file from settings-get")
+    command.add_argument("file")
+    command = commands.add_parser("mount", help="make a save block active (-1: none)")
+    command.add_argument("block", type=int)
+    command = commands.add_parser("launch", help="launch software by catalog ID (see list)")
+    command.add_argument("id", type=lambda x: int(x, 16))
+    sys.exit(main(parser.parse_args()))
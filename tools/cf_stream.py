@@ -0,0 +1,356 @@
+#!/usr/bin/python3
+#
+# Copyright (c) 2023 Adrian Siekierka
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+# WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+# MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+# SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+# RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+# CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+# CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+# Reference implementation of CartFriend's windowed streaming protocol (see
+# src/stream.h), used in place of XMODEM by the serial Tools entries.
+#
+# Every frame is:
+#
+#   0xA5, type, seq (uint16 LE), length (uint16 LE), payload,
+#   CRC-16/XMODEM of type..payload (uint16 BE)
+#
+# Frame types:
+#
+#   'H' hello: seq = protocol version (1), payload = size in bytes (uint32 LE)
+#       of the data the sending side is about to transfer, or 0. From the
+#       host, optionally followed by flags (uint8): bit 0 = the host can
+#       resume transfers. From the cartridge, optionally followed by the
+#       number of blocks (uint16 LE) of an interrupted transfer it has stored
+#       in order, and their CRC-16/XMODEM (uint16 LE): the transfer resumes
+#       from that block, unless the host cancels.
+#   'D' data: seq = block index, payload = up to 256 bytes. All blocks but
+#       the last are 256 bytes long.
+#   'A' acknowledgement: seq = base, the first block not received yet;
+#       payload = limit (uint16 LE), the first block which may not be sent
+#       yet, then a bitmap (uint32 LE) of received blocks, bit i standing
+#       for block base + i.
+#   'E' end: seq = block count. Sent once all blocks have been acknowledged;
+#       the receiver answers with the same frame.
+#   'X' cancel.
+#
+# The host starts a transfer by answering the cartridge's XMODEM start
+# request ('C' or NAK) with a hello frame, when sending; or by sending hello
+# frames until the cartridge, waiting to send over XMODEM, answers with its
+# own, when receiving. The sender keeps up to 32 blocks in flight, never
+# passing the receiver's limit. A block missing below one which has been
+# received is sent again right away; if nothing is acknowledged for a
+# second, the oldest unacknowledged block is.
+#
+# A cartridge receiving into flash remembers an interrupted transfer for as
+# long as CartFriend keeps running, and asks whether to resume it the next
+# time the same slot or save block is written to. The host then checks the
+# CRC against its own file, and either sends the rest of it, or cancels if
+# the file has changed in between.
+
+import argparse
+import struct
+import sys
+import time
+
+import cf_pack
+import cf_xmodem
+
+SYNC = 0xA5
+HELLO = ord('H')
+DATA = ord('D')
+ACK = ord('A')
+END = ord('E')
+CANCEL = ord('X')
+
+VERSION = 1
+HELLO_RESUME = 0x01
+BLOCK_SIZE = 256
+WINDOW = 32
+TIMEOUT = 1.0
+RETRIES = 10
+# the cartridge may stop the sender for a while to erase flash
+IDLE_TIMEOUT = 30.0
+
+class StreamError(Exception):
+    pass
+
+def encode_frame(ftype, seq, payload=b""):
+    body = struct.pack("<BHH", ftype, seq, len(payload)) + payload
+    return bytes([SYNC]) + body + struct.pack(">H", cf_xmodem.crc16(body))
+
+class FrameReader:
+    """Incremental frame parser; invalid frames are skipped."""
+    def __init__(self):
+        self.buf = bytearray()
+
+    def feed(self, data):
+        self.buf += data
+        frames = []
+        while True:
+            start = self.buf.find(SYNC)
+            if start < 0:
+                self.buf.clear()
+                break
+            del self.buf[:start]
+            if len(self.buf) < 6:
+                break
+            ftype, seq, length = struct.unpack("<BHH", self.buf[1:6])
+            if length > BLOCK_SIZE:
+                del self.buf[:1]
+                continue
+            if len(self.buf) < 8 + length:
+                break
+            body = bytes(self.buf[1:6 + length])
+            crc = struct.unpack(">H", self.buf[6 + length:8 + length])[0]
+            if crc == cf_xmodem.crc16(body):
+                frames.append((ftype, seq, body[5:]))
+                del self.buf[:8 + length]
+            else:
+                del self.buf[:1]
+        return frames
+
+class Stream:
+    def __init__(self, port):
+        self.port = port
+        self.reader = FrameReader()
+        self.pending = []
+        self.resumed = 0
+
+    def _write(self, ftype, seq, payload=b""):
+        self.port.write(encode_frame(ftype, seq, payload))
+
+    def _read_frame(self, timeout):
+        """Return the next valid frame, or None after timeout seconds."""
+        deadline = time.monotonic() + timeout
+        while not self.pending:
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                return None
+            self.port.timeout = min(remaining, 0.05)
+            data = self.port.read(max(1, self.port.in_waiting))
+            if data:
+                self.pending += self.reader.feed(data)
+        return self.pending.pop(0)
+
+    def _hello(self, size, flags=None):
+        if flags is None:
+            return struct.pack("<I", size)
+        return struct.pack("<IB", size, flags)
+
+    def send_blocks(self, data, progress=None, start=0):
+        """Run the sending side of a transfer which has been set up already,
+        from block start onwards."""
+        blocks = [data[i:i + BLOCK_SIZE] for i in range(0, len(data), BLOCK_SIZE)]
+        count = len(blocks)
+        base = start
+        next_block = start
+        limit = 0
+        resent = set()
+        last_progress = time.monotonic()
+        last_frame = time.monotonic()
+        retries = RETRIES
+
+        while base < count:
+            block = None
+            # only block for input if there is nothing to send
+            can_send = next_block < min(count, limit, base + WINDOW)
+            frame = self._read_frame(0 if can_send else 0.05)
+            now = time.monotonic()
+            if frame is not None:
+                last_frame = now
+                ftype, seq, payload = frame
+                if ftype == CANCEL:
+                    raise StreamError("cancelled by receiver")
+                elif ftype == ACK and len(payload) >= 6 and base <= seq <= next_block:
+                    if seq != base:
+                        resent = set(b for b in resent if b >= seq)
+                        base = seq
+                        last_progress = now
+                        retries = RETRIES
+                        if progress is not None:
+                            progress(min(base * BLOCK_SIZE, len(data)), len(data))
+                    limit, received = struct.unpack("<HI", payload[:6])
+                    if received:
+                        highest = received.bit_length() - 1
+                        for i in range(highest):
+                            if not (received >> i) & 1 and (base + i) not in resent:
+                                block = base + i
+                                resent.add(block)
+                                break
+
+            if block is None and base < next_block and now - last_progress > TIMEOUT:
+                retries -= 1
+                if retries == 0:
+                    self._write(CANCEL, 0)
+                    raise StreamError("too many retries")
+                block = base
+                resent = {base}
+                last_progress = now
+            if block is None and next_block < min(count, limit, base + WINDOW):
+                block = next_block
+                next_block += 1
+            if block is None and now - last_frame > IDLE_TIMEOUT:
+                self._write(CANCEL, 0)
+                raise StreamError("receiver stopped responding")
+
+            if block is not None:
+                self._write(DATA, block, blocks[block])
+
+        for _ in range(RETRIES):
+            self._write(END, count)
+            deadline = time.monotonic() + TIMEOUT
+            while True:
+                frame = self._read_frame(deadline - time.monotonic())
+                if frame is None:
+                    break
+                if frame[0] == CANCEL:
+                    raise StreamError("cancelled by receiver")
+                if frame[0] == END and frame[1] == count:
+                    return
+        raise StreamError("end of transfer not acknowledged")
+
+    def recv_blocks(self, size=0, progress=None):
+        """Run the receiving side of a transfer which has been set up already."""
+        blocks = {}
+        base = 0
+        last_frame = time.monotonic()
+
+        def ack():
+            received = 0
+            for i in range(1, WINDOW):
+                if (base + i) in blocks:
+                    received |= 1 << i
+            self._write(ACK, base, struct.pack("<HI", 0xFFFF, received))
+
+        ack()
+        while True:
+            frame = self._read_frame(TIMEOUT)
+            now = time.monotonic()
+            if frame is None:
+                if now - last_frame > IDLE_TIMEOUT:
+                    self._write(CANCEL, 0)
+                    raise StreamError("sender stopped responding")
+                # the sender may be waiting for a lost acknowledgement
+                ack()
+                continue
+            last_frame = now
+            ftype, seq, payload = frame
+            if ftype == CANCEL:
+                raise StreamError("cancelled by sender")
+            elif ftype == DATA:
+                if base <= seq < base + WINDOW:
+                    blocks[seq] = payload
+                    while base in blocks:
+                        base += 1
+                    if progress is not None:
+                        progress(base * BLOCK_SIZE, size)
+                ack()
+            elif ftype == END:
+                if base >= seq:
+                    self._write(END, seq)
+                    return b"".join(blocks[i] for i in range(seq))
+                ack()
+
+    def send(self, data, progress=None, start_timeout=60):
+        """Send data to a cartridge waiting to receive over XMODEM. If the
+        cartridge offers to resume an interrupted transfer of the same data,
+        only the rest is sent; self.resumed is set to the number of bytes
+        skipped."""
+        deadline = time.monotonic() + start_timeout
+        while True:
+            if time.monotonic() > deadline:
+                raise StreamError("receiver did not start the transfer")
+            self.port.timeout = 1
+            c = self.port.read(1)
+            if c and c[0] in (cf_xmodem.CRC, cf_xmodem.NAK):
+                break
+        for _ in range(RETRIES):
+            self._write(HELLO, VERSION, self._hello(len(data), HELLO_RESUME))
+            frame = self._read_frame(TIMEOUT)
+            if frame is not None and frame[0] == HELLO:
+                break
+            if frame is not None and frame[0] == CANCEL:
+                raise StreamError("cancelled by receiver")
+        else:
+            raise StreamError("receiver does not support streaming")
+        start = 0
+        if len(frame[2]) >= 8:
+            start, crc = struct.unpack("<HH", frame[2][4:8])
+            if start * BLOCK_SIZE > len(data) or cf_xmodem.crc16(data[:start * BLOCK_SIZE]) != crc:
+                self._write(CANCEL, 0)
+                raise StreamError("the interrupted transfer was of a different file; "
+                    "choose not to resume it on the cartridge")
+        self.resumed = min(start * BLOCK_SIZE, len(data))
+        self.start_time = time.monotonic()
+        self.send_blocks(data, progress, start)
+
+    def recv(self, progress=None, start_timeout=60):
+        """Receive data from a cartridge waiting to send over XMODEM."""
+        deadline = time.monotonic() + start_timeout
+        while True:
+            if time.monotonic() > deadline:
+                raise StreamError("sender did not start the transfer")
+            self._write(HELLO, VERSION, self._hello(0))
+            frame = self._read_frame(TIMEOUT)
+            if frame is not None and frame[0] == HELLO and len(frame[2]) >= 4:
+                size = struct.unpack("<I", frame[2][:4])[0]
+                break
+        self.start_time = time.monotonic()
+        data = self.recv_blocks(size, progress)
+        return data[:size] if size else data
+
+def main(args):
+    port = cf_xmodem.open_port(args.port, args.baudrate)
+    stream = Stream(port)
+
+    def progress(pos, total):
+        if total:
+            print("\r%d/%d bytes" % (pos, total), end="", flush=True)
+        else:
+            print("\r%d bytes" % pos, end="", flush=True)
+
+    size = None
+    if args.command == "send":
+        with open(args.file, "rb") as f:
+            data = f.read()
+        if args.compress and not cf_pack.is_packed(data):
+            packed = cf_pack.pack(data)
+            # incompressible data is better off sent as it is
+            if len(packed) < len(data):
+                print("Compressed %d bytes to %d" % (len(data), len(packed)))
+                size = len(data)
+                data = packed
+        print("Waiting for the cartridge...")
+        stream.send(data, progress)
+    else:
+        print("Waiting for the cartridge...")
+        data = stream.recv(progress)
+        with open(args.file, "wb") as f:
+            f.write(data)
+    print()
+    if stream.resumed:
+        print("Resumed an interrupted transfer after %d bytes" % stream.resumed)
+    # the time until the cartridge answered, and whatever an interrupted
+    # transfer had sent already, are not counted
+    elapsed = time.monotonic() - stream.start_time
+    sent = len(data) - stream.resumed
+    print("%d bytes in %.1f seconds (%.0f bytes/s)" % (sent, elapsed, sent / elapsed))
+    if size is not None and not stream.resumed:
+        print("%d bytes unpacked (%.0f bytes/s effective)" % (size, size / elapsed))
+    return 0
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Transfer files to or from a CartFriend cartridge using the streaming protocol")
+    parser.add_argument("-p", "--port", required=True, help="serial port connected to the EXT port")
+    parser.add_argument("-b", "--baudrate", type=int, default=38400, choices=[9600, 38400])
+    parser.add_argument("-z", "--compress", action="store_true", help="send: compress the file first (see cf_pack.py)")
+    parser.add_argument("command", choices=["send", "recv"])
+    parser.add_argument("file")
+    sys.exit(main(parser.parse_args()))
@@ -0,0 +1,174 @@
+#!/usr/bin/python3
+#
+# Copyright (c) 2023 Adrian Siekierka
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+# WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+# MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+# SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+# RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+# CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+# CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+# Minimal XMODEM (checksum, CRC and 1K) implementation, matching the one in
+# src/xmodem.c, for the host-side CartFriend tools.
+
+import time
+
+SOH = 0x01
+STX = 0x02
+EOT = 0x04
+ACK = 0x06
+NAK = 0x15
+CAN = 0x18
+CRC = 0x43 # 'C'
+
+class XModemError(Exception):
+    pass
+
+def crc16(data, crc=0):
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if (crc & 0x8000) else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+def open_port(port, baudrate):
+    import serial
+    return serial.Serial(port, baudrate, timeout=1)
+
+class XModem:
+    def __init__(self, port, retries=10, start_timeout=60):
+        self.port = port
+        self.retries = retries
+        self.start_timeout = start_timeout
+
+    def _getc(self, timeout=None):
+        if timeout is not None:
+            deadline = time.monotonic() + timeout
+            while time.monotonic() < deadline:
+                c = self.port.read(1)
+                if c:
+                    return c[0]
+            return None
+        c = self.port.read(1)
+        return c[0] if c else None
+
+    def _read_exact(self, n, timeout=10):
+        data = bytearray()
+        deadline = time.monotonic() + timeout
+        while len(data) < n and time.monotonic() < deadline:
+            data += self.port.read(n - len(data))
+        return bytes(data) if len(data) == n else None
+
+    def send(self, data, progress=None):
+        """Send data, padded to a whole number of blocks with 0x1A."""
+        # wait for the receiver to pick a mode
+        deadline = time.monotonic() + self.start_timeout
+        use_crc = None
+        while use_crc is None:
+            if time.monotonic() > deadline:
+                raise XModemError("receiver did not start the transfer")
+            c = self._getc()
+            if c == CRC:
+                use_crc = True
+            elif c == NAK:
+                use_crc = False
+            elif c == CAN:
+                raise XModemError("cancelled by receiver")
+
+        idx = 1
+        pos = 0
+        while pos < len(data):
+            size = 1024 if (use_crc and len(data) - pos > 128) else 128
+            block = data[pos:pos+size]
+            block = block + bytes([0x1A]) * (size - len(block))
+            frame = bytes([STX if size == 1024 else SOH, idx & 0xFF, (idx & 0xFF) ^ 0xFF]) + block
+            if use_crc:
+                crc = crc16(block)
+                frame += bytes([crc >> 8, crc & 0xFF])
+            else:
+                frame += bytes([sum(block) & 0xFF])
+
+            for _ in range(self.retries):
+                self.port.write(frame)
+                c = self._getc(timeout=30)
+                # skip any leftover start requests
+                while c == CRC:
+                    c = self._getc(timeout=30)
+                if c == ACK:
+                    break
+                elif c == CAN:
+                    raise XModemError("cancelled by receiver")
+            else:
+                raise XModemError("too many retries")
+
+            idx += 1
+            pos += size
+            if progress is not None:
+                progress(min(pos, len(data)), len(data))
+
+        for _ in range(self.retries):
+            self.port.write(bytes([EOT]))
+            if self._getc(timeout=10) == ACK:
+                return
+        raise XModemError("end of transfer not acknowledged")
+
+    def recv(self, use_crc=True, progress=None):
+        """Receive data; the result includes the sender's block padding."""
+        data = bytearray()
+        idx = 1
+        deadline = time.monotonic() + self.start_timeout
+        started = False
+        while True:
+            if not started:
+                if time.monotonic() > deadline:
+                    raise XModemError("sender did not start the transfer")
+                self.port.write(bytes([CRC if use_crc else NAK]))
+                # the sender may take a while to prepare its first block
+                c = self._getc(timeout=3)
+            else:
+                c = self._getc(timeout=30)
+            if c is None:
+                if started:
+                    raise XModemError("timed out")
+                continue
+            if c == EOT:
+                self.port.write(bytes([ACK]))
+                return bytes(data)
+            elif c == CAN:
+                raise XModemError("cancelled by sender")
+            elif c not in (SOH, STX):
+                continue
+
+            started = True
+            size = 1024 if c == STX else 128
+            frame = self._read_exact(2 + size + (2 if use_crc else 1))
+            if frame is None:
+                self.port.write(bytes([NAK]))
+                continue
+            block = frame[2:2+size]
+            if use_crc:
+                ok = ((frame[-2] << 8) | frame[-1]) == crc16(block)
+            else:
+                ok = frame[-1] == (sum(block) & 0xFF)
+            if not ok or frame[0] ^ frame[1] != 0xFF:
+                self.port.write(bytes([NAK]))
+                continue
+            if frame[0] == ((idx - 1) & 0xFF):
+                # our ACK was lost; the sender repeated the last block
+                self.port.write(bytes([ACK]))
+                continue
+            if frame[0] != (idx & 0xFF):
+                self.port.write(bytes([CAN, CAN]))
+                raise XModemError("unexpected block number")
+
+            data += block
+            idx += 1
+            self.port.write(bytes([ACK]))
+            if progress is not None:
+                progress(len(data), None)
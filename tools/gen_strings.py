@@ -60,6 +60,16 @@ def transform_string(s, loc):
 				so += '?'
 	return so
 
+def string_glyphs(s):
+	# undo the C escapes emitted by c_chr(), and those written in the source files
+	for m in re.finditer(r"\\([0-7]{3})|\\x([0-9a-fA-F]{2})|(.)", s):
+		if m.group(1):
+			yield int(m.group(1), 8)
+		elif m.group(2):
+			yield int(m.group(2), 16)
+		else:
+			yield ord(m.group(3))
+
 properties = {}
 property_langs = {}
 property_idx = 0
@@ -83,6 +93,91 @@ for fn in glob.glob("lang//*.properties"):
 					property_keys[kv[0]] = property_idx
 					property_idx += 1
 
+# Check format directives against the subset supported by src/format.c, and
+# make sure every translation takes the same arguments as the English string.
+# Translations may leave out trailing arguments.
+format_directive_re = re.compile(r"%(0?[0-9]*)(l?)(.?)")
+format_supported = "cdsuX%"
+format_errors = 0
+
+def format_arguments(k, lang_key, s):
+	global format_errors
+	args = []
+	for m in format_directive_re.finditer(s):
+		# a lone '%' at the end of the string has no conversion at all
+		if not m.group(3) or m.group(3) not in format_supported or (m.group(2) and m.group(3) in "cs%"):
+			print("Error: unsupported format directive '%s' in %s (locale %s)!" % (m.group(0), k, lang_key), file = sys.stderr)
+			format_errors += 1
+		elif m.group(3) != "%":
+			args.append(m.group(2) + ("s" if m.group(3) == "s" else "c" if m.group(3) == "c" else "d"))
+	return args
+
+for k, vv in properties.items():
+	if "en" not in vv:
+		continue
+	en_args = format_arguments(k, "en", vv["en"])
+	for lang_key, v in vv.items():
+		args = format_arguments(k, lang_key, v)
+		if lang_key != "en" and args != en_args[:len(args)]:
+			print("Error: format arguments of %s (locale %s) do not match English!" % (k, lang_key), file = sys.stderr)
+			format_errors += 1
+
+if format_errors > 0:
+	sys.exit(1)
+
+# Compress the strings with a shared dictionary: byte values from
+# TOKEN_FIRST upwards each stand for one dictionary entry. Entries only
+# contain plain characters, so every string decodes in a single pass.
+TOKEN_FIRST = 0xA0
+TOKEN_COUNT = 0x100 - TOKEN_FIRST
+TOKEN_MAX_LENGTH = 16
+
+def lang_string(k, lang_key):
+	vv = properties[k]
+	return bytes(string_glyphs(vv[lang_key] if lang_key in vv else vv["en"]))
+
+def compress_strings(strings):
+	dictionary = []
+	while len(dictionary) < TOKEN_COUNT:
+		counts = {}
+		for s in strings:
+			for l in range(2, TOKEN_MAX_LENGTH + 1):
+				for i in range(0, len(s) - l + 1):
+					sub = s[i:i+l]
+					if max(sub) < TOKEN_FIRST:
+						counts[sub] = counts.get(sub, 0) + 1
+		best = None
+		best_savings = 0
+		for sub, count in counts.items():
+			# each use saves len - 1 bytes; the entry costs len + 2 bytes
+			savings = count * (len(sub) - 1) - len(sub) - 2
+			if savings > best_savings:
+				best = sub
+				best_savings = savings
+		if best is None:
+			break
+		token = bytes([TOKEN_FIRST + len(dictionary)])
+		strings = [s.replace(best, token) for s in strings]
+		dictionary.append(best)
+	return strings, dictionary
+
+def c_bytes(fp, name, data):
+	print(f"const uint8_t __far {name}[] = {{", file = fp)
+	for i in range(0, len(data), 16):
+		print("\t" + ", ".join(str(x) for x in data[i:i+16]) + ",", file = fp)
+	print("};", file = fp)
+
+raw_strings = []
+for lang_key in property_langs.keys():
+	for k in property_keys.keys():
+		v = lang_string(k, lang_key)
+		if len(v) > 0 and max(v) >= TOKEN_FIRST:
+			print("Error: %s (locale %s) uses a glyph reserved for compression!" % (k, lang_key), file = sys.stderr)
+			sys.exit(1)
+		if v not in raw_strings:
+			raw_strings.append(v)
+compressed_strings, dictionary = compress_strings(raw_strings)
+
 with (
 	open(sys.argv[2], "w") as fp_c,
 	open(sys.argv[3], "w") as fp_h,
@@ -93,33 +188,52 @@ with (
 	print("#include <stdint.h>\n#include \"%s\"\n" % Path(sys.argv[3]).name, file = fp_c)
 	print("// Auto-generated file. Please do not edit directly.\n", file = fp_h)
 	print(f"#ifndef {hdr_define}\n#define {hdr_define}\n", file = fp_h)
+	print("#include <stdint.h>\n", file = fp_h)
 
 	for k, v in sorted(property_keys.items(), key=lambda x: x[1]):
 		print(f"#define LK_{k} {v}", file = fp_h)
 	print(f"#define LK_TOTAL {property_idx}\n", file = fp_h)
+
+	print(f"#define LANG_TOKEN_FIRST 0x{TOKEN_FIRST:02X}", file = fp_h)
+	print(f"#define LANG_MAX_LENGTH {max(len(x) for x in raw_strings)}", file = fp_h)
+	print("extern const uint8_t __far lang_dict[];", file = fp_h)
+	print(f"extern const uint16_t __far lang_dict_offsets[{len(dictionary) + 1}];", file = fp_h)
+	print("extern const uint8_t __far lang_data[];", file = fp_h)
 	for k in property_langs.keys():
-		print(f"extern const char __far* const __far lang_keys_{k}[{property_idx}];", file = fp_h)
+		print(f"extern const uint16_t __far lang_keys_{k}[{property_idx}];", file = fp_h)
+
+	# Emit the 32-glyph font blocks used by each language's strings
+	print("", file = fp_h)
+	for lang_key in property_langs.keys():
+		blocks = 0
+		for k in property_keys.keys():
+			for c in lang_string(k, lang_key):
+				blocks |= 1 << (c >> 5)
+		print(f"#define LANG_GLYPH_BLOCKS_{lang_key.upper()} 0x{blocks:04X}", file = fp_h)
+
+	# Emit the dictionary
+	dict_offsets = [0]
+	for entry in dictionary:
+		dict_offsets.append(dict_offsets[-1] + len(entry))
+	c_bytes(fp_c, "lang_dict", b"".join(dictionary) or b"\0")
+	print("\nconst uint16_t __far lang_dict_offsets[] = {", file = fp_c)
+	print("\t" + ", ".join(str(x) for x in dict_offsets), file = fp_c)
+	print("};\n", file = fp_c)
 
 	# Emit strings
-	property_strings = {}
-	property_string_idx = 0
-	for k, vv in properties.items():
-		for lang_key, v in vv.items():
-			if v not in property_strings:
-				print(f"const char __far lk_entry_{property_string_idx}[] = \"{v}\";", file = fp_c)
-				property_strings[v] = property_string_idx
-				property_string_idx += 1
-
-	# Emit string arrays
+	string_offsets = {}
+	data = bytearray()
+	for raw, compressed in zip(raw_strings, compressed_strings):
+		string_offsets[raw] = len(data)
+		data += compressed + b"\0"
+	c_bytes(fp_c, "lang_data", data)
+
+	# Emit string offset arrays
 	for lang_key in property_langs.keys():
-		print(f"\nconst char __far* const __far lang_keys_{lang_key}[] = ", file = fp_c, end='')
+		print(f"\nconst uint16_t __far lang_keys_{lang_key}[] = ", file = fp_c, end='')
 		print("{", file = fp_c)
 		for k, v in sorted(property_keys.items(), key=lambda x: x[1]):
-			local_lang_key = lang_key
-			if local_lang_key not in properties[k]:
-				local_lang_key = "en"
-			sv = properties[k][local_lang_key]
-			print(f"\tlk_entry_{property_strings[sv]}, // {k}", file = fp_c)
+			print(f"\t{string_offsets[lang_string(k, lang_key)]}, // {k}", file = fp_c)
 		print("};", file = fp_c)
 
 	print("\n#endif", file = fp_h);